@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "Fixture.h"
+#include "Model.h"
+
+// Qt
+#include <QTest>
+
+// std
+#include <cstdlib>
+
+Q_DECLARE_METATYPE(Direction)
+Q_DECLARE_METATYPE(Model::AnimationKind)
+
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+static bool s_countAllocations = false;
+static int s_allocationCount = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    if (s_countAllocations) {
+        ++s_allocationCount;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    if (s_countAllocations) {
+        ++s_allocationCount;
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    if (s_countAllocations) {
+        ++s_allocationCount;
+    }
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+/**
+ * Checks that the per-frame path of the model doesn't touch the heap. Only
+ * the first frame of an animation is allowed to allocate.
+ **/
+class ModelAllocationTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void steadyStateFramesDontAllocate_data();
+    void steadyStateFramesDontAllocate();
+    void reversalsDontAllocate_data();
+    void reversalsDontAllocate();
+};
+
+// The default grid resolution and the largest one the KCM allows.
+static const int gridResolutions[] = { 30, 99 };
+
+static void runFrame(Model& model, int gridResolution)
+{
+    model.step(std::chrono::milliseconds(16));
+    model.mesh(gridResolution);
+    model.translation();
+    model.boundingRect();
+    if (model.needsClip()) {
+        model.clipRect();
+        model.clipRegion();
+    }
+}
+
+void ModelAllocationTest::steadyStateFramesDontAllocate_data()
+{
+    QTest::addColumn<Direction>("direction");
+    QTest::addColumn<Model::AnimationKind>("kind");
+    QTest::addColumn<int>("gridResolution");
+
+    const Direction directions[] = { Direction::Left, Direction::Top, Direction::Right, Direction::Bottom };
+    const char* directionNames[] = { "left", "top", "right", "bottom" };
+    const Model::AnimationKind kinds[] = { Model::AnimationKind::Minimize, Model::AnimationKind::Unminimize };
+    const char* kindNames[] = { "minimize", "unminimize" };
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            for (int gridResolution : gridResolutions) {
+                QTest::addRow("%s-%s-grid%d", directionNames[i], kindNames[j], gridResolution)
+                    << directions[i] << kinds[j] << gridResolution;
+            }
+        }
+    }
+}
+
+void ModelAllocationTest::steadyStateFramesDontAllocate()
+{
+#if defined(__GLIBC__)
+    QFETCH(Direction, direction);
+    QFETCH(Model::AnimationKind, kind);
+    QFETCH(int, gridResolution);
+
+    Model model;
+    model.setParameters(defaultModelParameters());
+    model.setGeometry(makeOverlappingGeometry(direction));
+    model.start(kind);
+
+    // The first frame sizes the buffers that are reused afterwards.
+    runFrame(model, gridResolution);
+
+    int allocationCount = 0;
+    while (!model.done()) {
+        s_allocationCount = 0;
+        s_countAllocations = true;
+        runFrame(model, gridResolution);
+        s_countAllocations = false;
+
+        allocationCount += s_allocationCount;
+    }
+
+    QCOMPARE(allocationCount, 0);
+#else
+    QSKIP("Counting allocations requires glibc");
+#endif
+}
+
+void ModelAllocationTest::reversalsDontAllocate_data()
+{
+    QTest::addColumn<int>("gridResolution");
+
+    for (int gridResolution : gridResolutions) {
+        QTest::addRow("grid%d", gridResolution) << gridResolution;
+    }
+}
+
+void ModelAllocationTest::reversalsDontAllocate()
+{
+#if defined(__GLIBC__)
+    QFETCH(int, gridResolution);
+
+    // Toggle the window every 20ms while frames are presented every 16ms.
+    const int toggleInterval = 20;
+    const int toggleDuration = 2000;
+
+    Model model;
+    model.setParameters(defaultModelParameters());
+    model.setGeometry(makeOverlappingGeometry(Direction::Bottom));
+
+    Model::AnimationKind kind = Model::AnimationKind::Minimize;
+    model.start(kind);
+    runFrame(model, gridResolution);
+
+    int allocationCount = 0;
+    int nextToggle = toggleInterval;
+    bool restarted = false;
+    for (int time = 16; time <= toggleDuration; time += 16) {
+        s_allocationCount = 0;
+        s_countAllocations = !restarted;
+        runFrame(model, gridResolution);
+        s_countAllocations = false;
+        allocationCount += s_allocationCount;
+
+        restarted = false;
+        for (; nextToggle <= time; nextToggle += toggleInterval) {
+            kind = kind == Model::AnimationKind::Minimize
+                ? Model::AnimationKind::Unminimize
+                : Model::AnimationKind::Minimize;
+
+            // An animation that has already finished is started anew, which
+            // is allowed to allocate like the first frame of any animation.
+            if (model.done()) {
+                model.start(kind);
+                restarted = true;
+                continue;
+            }
+
+            s_allocationCount = 0;
+            s_countAllocations = true;
+            model.start(kind);
+            s_countAllocations = false;
+            allocationCount += s_allocationCount;
+        }
+    }
+
+    QCOMPARE(allocationCount, 0);
+#else
+    QSKIP("Counting allocations requires glibc");
+#endif
+}
+
+QTEST_GUILESS_MAIN(ModelAllocationTest)
+
+#include "ModelAllocationTest.moc"
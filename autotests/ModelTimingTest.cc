@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "AnimationScheduler.h"
+#include "Fixture.h"
+#include "Model.h"
+
+// Qt
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTest>
+
+// std
+#include <algorithm>
+#include <limits>
+
+Q_DECLARE_METATYPE(Direction)
+Q_DECLARE_METATYPE(Model::AnimationKind)
+
+// How much slower late frames may be than early frames regardless of their
+// cost, so that scheduling noise on loaded machines doesn't fail the test.
+static const qint64 maximumFrameTimeJitter = 20000;
+
+/**
+ * Checks that animations finish on time when the compositor stalls, and
+ * that frames stay as cheap while the window is toggled repeatedly.
+ **/
+class ModelTimingTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void finishesOnTimeAfterStall_data();
+    void finishesOnTimeAfterStall();
+    void toggleAtFiftyHertz_data();
+    void toggleAtFiftyHertz();
+};
+
+static void addStallRows(int stall)
+{
+    const Direction directions[] = { Direction::Left, Direction::Top, Direction::Right, Direction::Bottom };
+    const char* directionNames[] = { "left", "top", "right", "bottom" };
+    const Model::AnimationKind kinds[] = { Model::AnimationKind::Minimize, Model::AnimationKind::Unminimize };
+    const char* kindNames[] = { "minimize", "unminimize" };
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 2; ++j) {
+            QTest::addRow("%s-%s-%dms", directionNames[i], kindNames[j], stall)
+                << directions[i] << kinds[j] << stall;
+        }
+    }
+}
+
+void ModelTimingTest::finishesOnTimeAfterStall_data()
+{
+    QTest::addColumn<Direction>("direction");
+    QTest::addColumn<Model::AnimationKind>("kind");
+    QTest::addColumn<int>("stall");
+
+    addStallRows(16);
+    addStallRows(50);
+    addStallRows(200);
+    addStallRows(500);
+}
+
+void ModelTimingTest::finishesOnTimeAfterStall()
+{
+    QFETCH(Direction, direction);
+    QFETCH(Model::AnimationKind, kind);
+    QFETCH(int, stall);
+
+    const Model::Parameters parameters = defaultModelParameters();
+    const Model::Geometry geometry = makeOverlappingGeometry(direction);
+    const int duration = nominalDuration(parameters, geometry, kind).count();
+    const int frameTime = 16;
+
+    Model model;
+    model.setParameters(parameters);
+    model.setGeometry(geometry);
+    model.start(kind);
+
+    // The first frame is late, the following ones are on time.
+    model.step(std::chrono::milliseconds(stall));
+    int frameCount = 1;
+    while (!model.done()) {
+        model.step(std::chrono::milliseconds(frameTime));
+        ++frameCount;
+    }
+
+    // The animation has to finish on the first frame that is presented
+    // after its nominal duration.
+    int expectedFrameCount = 1;
+    if (duration > stall) {
+        expectedFrameCount += (duration - stall + frameTime - 1) / frameTime;
+    }
+    QCOMPARE(frameCount, expectedFrameCount);
+}
+
+void ModelTimingTest::toggleAtFiftyHertz_data()
+{
+    QTest::addColumn<Direction>("direction");
+
+    QTest::newRow("left") << Direction::Left;
+    QTest::newRow("top") << Direction::Top;
+    QTest::newRow("right") << Direction::Right;
+    QTest::newRow("bottom") << Direction::Bottom;
+}
+
+void ModelTimingTest::toggleAtFiftyHertz()
+{
+    QFETCH(Direction, direction);
+
+    // The window is minimized and unminimized every 20ms for two seconds,
+    // while frames are presented every 16ms. Toggles go through the
+    // scheduler and frames are run like in the effect, so the reversal path
+    // is the one the effect takes. The run is repeated and the fastest time
+    // of every frame is kept to filter out noise.
+    const Model::Parameters parameters = defaultModelParameters();
+    const Model::Geometry geometry = makeOverlappingGeometry(direction);
+    const int frameTime = 16;
+    const int toggleInterval = 20;
+    const int toggleDuration = 2000;
+    const int gridResolution = 30;
+    const int repetitions = 5;
+    const qint64 cost = qint64(geometry.expandedRect.width()) * geometry.expandedRect.height();
+
+    // The scheduler only compares the windows, they are never dereferenced.
+    KWin::EffectWindow* window = reinterpret_cast<KWin::EffectWindow*>(quintptr(1));
+
+    const int frameCount = toggleDuration / frameTime;
+    QVector<qint64> frameTimes(frameCount, std::numeric_limits<qint64>::max());
+
+    QMap<KWin::EffectWindow*, Model> models;
+    AnimationScheduler scheduler;
+    QVector<AnimationScheduler::PendingAnimation> admitted;
+    Model::AnimationKind kind = Model::AnimationKind::Minimize;
+    QElapsedTimer timer;
+
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        models.clear();
+        scheduler.clear();
+
+        kind = Model::AnimationKind::Minimize;
+        scheduler.request(window, kind, nullptr, true, cost);
+
+        int nextToggle = toggleInterval;
+        for (int frame = 0; frame < frameCount; ++frame) {
+            const int time = (frame + 1) * frameTime;
+            const std::chrono::milliseconds delta(frame ? frameTime : 0);
+
+            // Same as YetAnotherMagicLampEffect::prePaintScreen().
+            timer.start();
+            for (Model& model : models) {
+                model.step(delta);
+            }
+            scheduler.admit(delta, admitted);
+            for (const AnimationScheduler::PendingAnimation& pending : admitted) {
+                Model& model = models[pending.window];
+                model.setParameters(parameters);
+                model.setGeometry(geometry);
+                model.start(pending.kind);
+            }
+            for (Model& model : models) {
+                model.mesh(gridResolution);
+            }
+            frameTimes[frame] = qMin(frameTimes[frame], timer.nsecsElapsed());
+
+            // Same as YetAnotherMagicLampEffect::postPaintScreen().
+            auto modelIt = models.begin();
+            while (modelIt != models.end()) {
+                if ((*modelIt).done()) {
+                    modelIt = models.erase(modelIt);
+                } else {
+                    ++modelIt;
+                }
+            }
+
+            for (; nextToggle <= time; nextToggle += toggleInterval) {
+                kind = kind == Model::AnimationKind::Minimize
+                    ? Model::AnimationKind::Unminimize
+                    : Model::AnimationKind::Minimize;
+
+                auto toggledIt = models.find(window);
+                Model* model = toggledIt != models.end() ? &(*toggledIt) : nullptr;
+                scheduler.request(window, kind, model, true, cost);
+            }
+        }
+    }
+
+    // Reversing an animation only flips its timeline, so frames must not
+    // get more expensive the more often the animation has been reversed.
+    // The first frames size the buffers, so they are left out.
+    const int sampleCount = frameCount / 4;
+    QVector<qint64> earlyFrames = frameTimes.mid(8, sampleCount);
+    QVector<qint64> lateFrames = frameTimes.mid(frameCount - sampleCount);
+    std::sort(earlyFrames.begin(), earlyFrames.end());
+    std::sort(lateFrames.begin(), lateFrames.end());
+    const qint64 earlyMedian = earlyFrames[sampleCount / 2];
+    const qint64 lateMedian = lateFrames[sampleCount / 2];
+    QVERIFY2(lateMedian <= 2 * earlyMedian + maximumFrameTimeJitter,
+        qPrintable(QStringLiteral("late frames take %1ns, early frames take %2ns").arg(lateMedian).arg(earlyMedian)));
+
+    // Once the toggling stops, the animation that was started last must not
+    // take longer than if it had been started from scratch.
+    auto modelIt = models.find(window);
+    if (modelIt == models.end()) {
+        return;
+    }
+    const int duration = nominalDuration(parameters, geometry, kind).count();
+    int remaining = 0;
+    while (!(*modelIt).done()) {
+        (*modelIt).step(std::chrono::milliseconds(frameTime));
+        remaining += frameTime;
+    }
+    QVERIFY2(remaining <= duration + frameTime,
+        qPrintable(QStringLiteral("finished after %1ms, nominal duration is %2ms").arg(remaining).arg(duration)));
+}
+
+QTEST_GUILESS_MAIN(ModelTimingTest)
+
+#include "ModelTimingTest.moc"
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "AnimationScheduler.h"
+
+// std
+#include <algorithm>
+
+// How many pixels worth of new animations may be started in a single frame.
+static const qint64 admissionBudget = 2 * 1920 * 1080;
+
+// The maximum amount of time by which the start of an animation may be delayed.
+static const std::chrono::milliseconds maximumAdmissionDelay(100);
+
+AnimationScheduler::RequestResult AnimationScheduler::request(KWin::EffectWindow* window,
+    Model::AnimationKind kind, Model* model, bool canAnimate, qint64 cost)
+{
+    // Reverse the running animation in place, its mesh and texture are kept.
+    if (model && !model->done()) {
+        model->start(kind);
+        return RequestResult::Reversed;
+    }
+
+    // If the window is toggled before its animation has been started, there
+    // is nothing to animate anymore.
+    const PendingAnimation* pending = find(window);
+    if (pending) {
+        if (pending->kind == kind) {
+            return RequestResult::Ignored;
+        }
+        remove(window);
+        return RequestResult::Cancelled;
+    }
+
+    if (!canAnimate) {
+        return RequestResult::Ignored;
+    }
+
+    schedule(window, kind, cost);
+    return RequestResult::Scheduled;
+}
+
+void AnimationScheduler::schedule(KWin::EffectWindow* window, Model::AnimationKind kind, qint64 cost)
+{
+    PendingAnimation pending;
+    pending.window = window;
+    pending.kind = kind;
+    pending.cost = cost;
+    pending.waitTime = std::chrono::milliseconds::zero();
+    m_pendingAnimations.append(pending);
+}
+
+const AnimationScheduler::PendingAnimation* AnimationScheduler::find(KWin::EffectWindow* window) const
+{
+    auto it = std::find_if(m_pendingAnimations.constBegin(), m_pendingAnimations.constEnd(),
+        [window](const PendingAnimation& pending) { return pending.window == window; });
+    if (it == m_pendingAnimations.constEnd()) {
+        return nullptr;
+    }
+    return &(*it);
+}
+
+void AnimationScheduler::remove(KWin::EffectWindow* window)
+{
+    auto it = std::find_if(m_pendingAnimations.begin(), m_pendingAnimations.end(),
+        [window](const PendingAnimation& pending) { return pending.window == window; });
+    if (it != m_pendingAnimations.end()) {
+        m_pendingAnimations.erase(it);
+    }
+}
+
+void AnimationScheduler::clear()
+{
+    m_pendingAnimations.clear();
+}
+
+void AnimationScheduler::admit(std::chrono::milliseconds delta, QVector<PendingAnimation>& admitted)
+{
+    admitted.clear();
+
+    for (PendingAnimation& pending : m_pendingAnimations) {
+        pending.waitTime += delta;
+    }
+
+    // Spread the allocation and rendering of offscreen textures over several
+    // frames instead of letting them land on a single one.
+    qint64 budget = admissionBudget;
+
+    auto it = m_pendingAnimations.begin();
+    while (it != m_pendingAnimations.end()) {
+        if (!admitted.isEmpty() && (*it).cost > budget && (*it).waitTime < maximumAdmissionDelay) {
+            ++it;
+            continue;
+        }
+
+        admitted.append(*it);
+        budget -= (*it).cost;
+
+        it = m_pendingAnimations.erase(it);
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Own
+#include "Model.h"
+
+// kwineffects
+#include <kwineffects.h>
+
+// Qt
+#include <QVector>
+
+// std
+#include <chrono>
+
+/**
+ * Spreads the start of animations over several frames if a lot of windows
+ * are minimized or unminimized at once, e.g. by "Show Desktop". The windows
+ * are only used as keys, so the scheduler can be driven without KWin.
+ **/
+class AnimationScheduler {
+public:
+    struct PendingAnimation {
+        KWin::EffectWindow* window;
+        Model::AnimationKind kind;
+
+        // How many pixels have to be rendered offscreen to start the animation.
+        qint64 cost;
+
+        // How long the animation has been waiting to be started.
+        std::chrono::milliseconds waitTime;
+    };
+
+    enum class RequestResult {
+        // The running animation of the window has been reversed.
+        Reversed,
+        // The pending animation of the window has been toggled back, so
+        // there is nothing to animate anymore.
+        Cancelled,
+        // The animation has been queued, see admit().
+        Scheduled,
+        // Nothing has changed.
+        Ignored
+    };
+
+    /**
+     * Handles the given window being minimized or unminimized. A running
+     * animation is reversed in place, a pending animation that is toggled
+     * back is cancelled, otherwise a new animation is queued.
+     *
+     * @param model The model of the window, or @c nullptr if it has none.
+     * @param canAnimate Whether a new animation can be started for the
+     *   window, e.g. whether it has an icon.
+     * @param cost The area of the window including its shadow.
+     **/
+    RequestResult request(KWin::EffectWindow* window, Model::AnimationKind kind,
+        Model* model, bool canAnimate, qint64 cost);
+
+    /**
+     * Queues an animation for the given window. The animation is started by
+     * a following call to admit().
+     *
+     * @param cost The area of the window including its shadow.
+     **/
+    void schedule(KWin::EffectWindow* window, Model::AnimationKind kind, qint64 cost);
+
+    /**
+     * Returns the pending animation of the given window, or @c nullptr if
+     * the window has none.
+     **/
+    const PendingAnimation* find(KWin::EffectWindow* window) const;
+
+    /**
+     * Removes the pending animation of the given window, if there is one.
+     **/
+    void remove(KWin::EffectWindow* window);
+
+    /**
+     * Removes all pending animations.
+     **/
+    void clear();
+
+    /**
+     * Returns whether there are no pending animations.
+     **/
+    bool isEmpty() const;
+
+    /**
+     * Advances the wait time of pending animations by @p delta and moves
+     * the animations that may start on this frame to @p admitted. At least
+     * one animation is admitted per frame, and none waits longer than the
+     * maximum admission delay.
+     *
+     * @param admitted Cleared and filled with the admitted animations, in
+     *   the order in which they were scheduled.
+     **/
+    void admit(std::chrono::milliseconds delta, QVector<PendingAnimation>& admitted);
+
+private:
+    QVector<PendingAnimation> m_pendingAnimations;
+};
+
+inline bool AnimationScheduler::isEmpty() const
+{
+    return m_pendingAnimations.isEmpty();
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "DockIndex.h"
+
+using namespace KWin;
+
+/**
+    \class DockIndex
+    \brief Keeps track of docks and the screen edges they are attached to.
+
+    The index is rebuilt when docks are added, removed or change their
+    geometry, so finding the dock that contains a task manager icon doesn't
+    require walking the whole stacking order. Docks are kept in the stacking
+    order, so overlapping docks are resolved the same way as by a walk.
+
+    Docks being added or removed and screen changes are always followed,
+    they're rare. Geometry changes are only followed while tracking is
+    enabled, so windows that are moved or resized while nothing is animating
+    cost nothing. Instead, the few known docks are checked for geometry
+    changes when tracking is enabled.
+*/
+
+/*!
+    Constructs a DockIndex object with the given \p parent.
+*/
+DockIndex::DockIndex(QObject *parent)
+    : QObject(parent)
+{
+    connect(effects, &EffectsHandler::windowAdded,
+            this, &DockIndex::slotWindowAdded);
+    connect(effects, &EffectsHandler::windowClosed,
+            this, &DockIndex::slotWindowRemoved);
+    connect(effects, &EffectsHandler::windowDeleted,
+            this, &DockIndex::slotWindowRemoved);
+    connect(effects, &EffectsHandler::numberScreensChanged,
+            this, &DockIndex::rebuild);
+    connect(effects, &EffectsHandler::virtualScreenGeometryChanged,
+            this, &DockIndex::rebuild);
+
+    rebuild();
+}
+
+/*!
+    Returns the dock that contains the given \p iconRect, or \c nullptr if
+    there is no such dock.
+
+    The returned pointer is valid until the index is modified.
+*/
+const DockIndex::Dock *DockIndex::findDock(const QRect &iconRect) const
+{
+    const int screen = effects->screenNumber(iconRect.center());
+    if (screen >= 0 && screen < m_screenDocks.count()) {
+        for (const Dock &dock : m_screenDocks[screen]) {
+            if (dock.geometry.intersects(iconRect))
+                return &dock;
+        }
+        return nullptr;
+    }
+
+    // The icon is not on any screen, fall back to checking all docks.
+    for (const Dock &dock : m_docks) {
+        if (dock.geometry.intersects(iconRect))
+            return &dock;
+    }
+
+    return nullptr;
+}
+
+/*!
+    Returns the geometry of the given \p screen.
+*/
+QRect DockIndex::screenArea(int screen) const
+{
+    if (screen < 0 || screen >= m_screenAreas.count())
+        return effects->clientArea(ScreenArea, screen, effects->currentDesktop());
+
+    return m_screenAreas[screen];
+}
+
+/*!
+    Returns \c true if the index follows geometry changes of docks.
+*/
+bool DockIndex::isTracking() const
+{
+    return bool(m_windowGeometryShapeChangedConnection);
+}
+
+/*!
+    Sets whether the index follows geometry changes of docks. When
+    \p tracking is enabled, the index is only rebuilt if a dock has been
+    moved or resized in the meanwhile.
+*/
+void DockIndex::setTracking(bool tracking)
+{
+    if (tracking == isTracking())
+        return;
+
+    if (!tracking) {
+        disconnect(m_windowGeometryShapeChangedConnection);
+        m_windowGeometryShapeChangedConnection = QMetaObject::Connection();
+        return;
+    }
+
+    m_windowGeometryShapeChangedConnection = connect(effects, &EffectsHandler::windowGeometryShapeChanged,
+                                                     this, &DockIndex::slotWindowGeometryShapeChanged);
+
+    for (auto it = m_dockWindows.constBegin(); it != m_dockWindows.constEnd(); ++it) {
+        if (it.key()->geometry() != it.value()) {
+            rebuild();
+            return;
+        }
+    }
+}
+
+// Docks rarely change, so the index is simply rebuilt. That also keeps the
+// docks in the stacking order.
+
+void DockIndex::slotWindowAdded(EffectWindow *window)
+{
+    if (window->isDock())
+        rebuild();
+}
+
+void DockIndex::slotWindowRemoved(EffectWindow *window)
+{
+    if (m_dockWindows.contains(window))
+        build(window);
+}
+
+void DockIndex::slotWindowGeometryShapeChanged(EffectWindow *window, const QRect &old)
+{
+    Q_UNUSED(old)
+
+    if (m_dockWindows.contains(window))
+        rebuild();
+}
+
+void DockIndex::rebuild()
+{
+    build(nullptr);
+}
+
+void DockIndex::build(EffectWindow *excludedWindow)
+{
+    m_docks.clear();
+    m_screenDocks.clear();
+    m_dockWindows.clear();
+    m_screenAreas.clear();
+
+    const int desktop = effects->currentDesktop();
+    const int screenCount = effects->numScreens();
+
+    m_screenDocks.resize(screenCount);
+    m_screenAreas.reserve(screenCount);
+    for (int screen = 0; screen < screenCount; ++screen)
+        m_screenAreas.append(effects->clientArea(ScreenArea, screen, desktop));
+
+    const EffectWindowList windows = effects->stackingOrder();
+    for (EffectWindow *window : windows) {
+        if (window->isDock() && !window->isDeleted() && window != excludedWindow)
+            insertDock(window);
+    }
+}
+
+void DockIndex::insertDock(EffectWindow *window)
+{
+    const QRect geometry = window->geometry();
+    const QRect screenRect = screenArea(effects->screenNumber(geometry.center()));
+
+    Dock dock;
+    dock.geometry = geometry;
+    dock.screenRect = screenRect;
+
+    if (geometry.width() >= geometry.height()) {
+        if (geometry.y() == screenRect.y())
+            dock.edge = Direction::Top;
+        else
+            dock.edge = Direction::Bottom;
+    } else {
+        if (geometry.x() == screenRect.x())
+            dock.edge = Direction::Left;
+        else
+            dock.edge = Direction::Right;
+    }
+
+    m_docks.append(dock);
+    m_dockWindows.insert(window, geometry);
+
+    // A dock can span several screens, e.g. if it's placed between them.
+    for (int screen = 0; screen < m_screenAreas.count(); ++screen) {
+        if (m_screenAreas[screen].intersects(geometry))
+            m_screenDocks[screen].append(dock);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Own
+#include "common.h"
+
+// kwineffects
+#include <kwineffects.h>
+
+// Qt
+#include <QObject>
+#include <QHash>
+#include <QVector>
+
+class DockIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Dock
+    {
+        // The geometry of the dock.
+        QRect geometry;
+
+        // The geometry of the screen the dock is attached to.
+        QRect screenRect;
+
+        // The screen edge the dock is attached to.
+        Direction edge;
+    };
+
+    explicit DockIndex(QObject *parent = nullptr);
+
+    const Dock *findDock(const QRect &iconRect) const;
+    QRect screenArea(int screen) const;
+
+    bool isTracking() const;
+    void setTracking(bool tracking);
+
+private Q_SLOTS:
+    void slotWindowAdded(KWin::EffectWindow *window);
+    void slotWindowRemoved(KWin::EffectWindow *window);
+    void slotWindowGeometryShapeChanged(KWin::EffectWindow *window, const QRect &old);
+    void rebuild();
+
+private:
+    void build(KWin::EffectWindow *excludedWindow);
+    void insertDock(KWin::EffectWindow *window);
+
+    QVector<Dock> m_docks;
+    QVector<QVector<Dock>> m_screenDocks;
+    QHash<KWin::EffectWindow *, QRect> m_dockWindows;
+    QVector<QRect> m_screenAreas;
+    QMetaObject::Connection m_windowGeometryShapeChangedConnection;
+
+    Q_DISABLE_COPY(DockIndex)
+};
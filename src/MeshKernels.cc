@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "MeshKernels.h"
+
+// Qt
+#include <QVarLengthArray>
+
+static inline qreal interpolate(qreal from, qreal to, qreal t)
+{
+    return from * (1.0 - t) + to * t;
+}
+
+/**
+ * The scales along the axis of the animation, one per row or column of the
+ * grid boundaries. The KCM limits the grid resolution to 99, so the scales
+ * fit in the inline storage.
+ **/
+using GridScales = QVarLengthArray<qreal, 100>;
+
+/**
+ * Evaluates the scale once per column boundary of a row-major grid of
+ * quads. All quads in a column share their left and right edges.
+ **/
+template <typename Function>
+static void computeColumnScales(const QVector<WindowQuad>& quads, int gridResolution,
+    Function computeScale, GridScales& scales)
+{
+    scales.resize(gridResolution + 1);
+    for (int column = 0; column < gridResolution; ++column) {
+        scales[column] = computeScale(quads[column][0].x());
+    }
+    scales[gridResolution] = computeScale(quads[gridResolution - 1][2].x());
+}
+
+/**
+ * Evaluates the scale once per row boundary of a row-major grid of quads.
+ * All quads in a row share their top and bottom edges.
+ **/
+template <typename Function>
+static void computeRowScales(const QVector<WindowQuad>& quads, int gridResolution,
+    Function computeScale, GridScales& scales)
+{
+    scales.resize(gridResolution + 1);
+    for (int row = 0; row < gridResolution; ++row) {
+        scales[row] = computeScale(quads[row * gridResolution][0].y());
+    }
+    scales[gridResolution] = computeScale(quads[(gridResolution - 1) * gridResolution][2].y());
+}
+
+static void transformQuadsLeft(
+    const Model::Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    // FIXME: Have a generic function that transforms window quads. Perhaps,
+    // a better approach is to have a transform method that operates on each
+    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
+
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = windowRect.right() - iconRect.right() + params.bumpDistance;
+
+    const auto computeScale = [&](qreal offset) {
+        return params.stretchProgress * params.shapeCurve->valueForProgress((windowRect.width() - offset) / distance);
+    };
+
+    // The shape curve is evaluated once per column of the grid instead of
+    // once per quad.
+    const qreal squashOffset = interpolate(0.0, distance, params.squashProgress);
+    const int gridResolution = params.gridResolution;
+    GridScales scales;
+    if (gridResolution) {
+        computeColumnScales(quads, gridResolution,
+            [&](qreal x) { return computeScale(x - squashOffset); }, scales);
+    }
+
+    int column = 0;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal leftOffset = quad[0].x() - squashOffset;
+        const qreal rightOffset = quad[2].x() - squashOffset;
+
+        qreal leftScale;
+        qreal rightScale;
+        if (gridResolution) {
+            leftScale = scales[column];
+            rightScale = scales[column + 1];
+            if (++column == gridResolution) {
+                column = 0;
+            }
+        } else {
+            leftScale = computeScale(leftOffset);
+            rightScale = computeScale(rightOffset);
+        }
+
+        const qreal targetTopLeftY = iconRect.y() + iconRect.height() * quad[0].y() / windowRect.height();
+        const qreal targetTopRightY = iconRect.y() + iconRect.height() * quad[1].y() / windowRect.height();
+        const qreal targetBottomRightY = iconRect.y() + iconRect.height() * quad[2].y() / windowRect.height();
+        const qreal targetBottomLeftY = iconRect.y() + iconRect.height() * quad[3].y() / windowRect.height();
+
+        quad[0].setY(quad[0].y() + leftScale * (targetTopLeftY - (windowRect.y() + quad[0].y())));
+        quad[3].setY(quad[3].y() + leftScale * (targetBottomLeftY - (windowRect.y() + quad[3].y())));
+        quad[1].setY(quad[1].y() + rightScale * (targetTopRightY - (windowRect.y() + quad[1].y())));
+        quad[2].setY(quad[2].y() + rightScale * (targetBottomRightY - (windowRect.y() + quad[2].y())));
+
+        const qreal targetLeftOffset = leftOffset + params.bumpDistance * params.bumpProgress;
+        const qreal targetRightOffset = rightOffset + params.bumpDistance * params.bumpProgress;
+
+        quad[0].setX(targetLeftOffset);
+        quad[3].setX(targetLeftOffset);
+        quad[1].setX(targetRightOffset);
+        quad[2].setX(targetRightOffset);
+    }
+}
+
+static void transformQuadsTop(
+    const Model::Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    // FIXME: Have a generic function that transforms window quads. Perhaps,
+    // a better approach is to have a transform method that operates on each
+    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
+
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = windowRect.bottom() - iconRect.bottom() + params.bumpDistance;
+
+    const auto computeScale = [&](qreal offset) {
+        return params.stretchProgress * params.shapeCurve->valueForProgress((windowRect.height() - offset) / distance);
+    };
+
+    // The shape curve is evaluated once per row of the grid instead of
+    // once per quad.
+    const qreal squashOffset = interpolate(0.0, distance, params.squashProgress);
+    const int gridResolution = params.gridResolution;
+    GridScales scales;
+    if (gridResolution) {
+        computeRowScales(quads, gridResolution,
+            [&](qreal y) { return computeScale(y - squashOffset); }, scales);
+    }
+
+    int row = 0;
+    int column = 0;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal topOffset = quad[0].y() - squashOffset;
+        const qreal bottomOffset = quad[2].y() - squashOffset;
+
+        qreal topScale;
+        qreal bottomScale;
+        if (gridResolution) {
+            topScale = scales[row];
+            bottomScale = scales[row + 1];
+            if (++column == gridResolution) {
+                column = 0;
+                ++row;
+            }
+        } else {
+            topScale = computeScale(topOffset);
+            bottomScale = computeScale(bottomOffset);
+        }
+
+        const qreal targetTopLeftX = iconRect.x() + iconRect.width() * quad[0].x() / windowRect.width();
+        const qreal targetTopRightX = iconRect.x() + iconRect.width() * quad[1].x() / windowRect.width();
+        const qreal targetBottomRightX = iconRect.x() + iconRect.width() * quad[2].x() / windowRect.width();
+        const qreal targetBottomLeftX = iconRect.x() + iconRect.width() * quad[3].x() / windowRect.width();
+
+        quad[0].setX(quad[0].x() + topScale * (targetTopLeftX - (windowRect.x() + quad[0].x())));
+        quad[1].setX(quad[1].x() + topScale * (targetTopRightX - (windowRect.x() + quad[1].x())));
+        quad[2].setX(quad[2].x() + bottomScale * (targetBottomRightX - (windowRect.x() + quad[2].x())));
+        quad[3].setX(quad[3].x() + bottomScale * (targetBottomLeftX - (windowRect.x() + quad[3].x())));
+
+        const qreal targetTopOffset = topOffset + params.bumpDistance * params.bumpProgress;
+        const qreal targetBottomOffset = bottomOffset + params.bumpDistance * params.bumpProgress;
+
+        quad[0].setY(targetTopOffset);
+        quad[1].setY(targetTopOffset);
+        quad[2].setY(targetBottomOffset);
+        quad[3].setY(targetBottomOffset);
+    }
+}
+
+static void transformQuadsRight(
+    const Model::Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    // FIXME: Have a generic function that transforms window quads. Perhaps,
+    // a better approach is to have a transform method that operates on each
+    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
+
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = iconRect.left() - windowRect.left() + params.bumpDistance;
+
+    const auto computeScale = [&](qreal offset) {
+        return params.stretchProgress * params.shapeCurve->valueForProgress(offset / distance);
+    };
+
+    // The shape curve is evaluated once per column of the grid instead of
+    // once per quad.
+    const qreal squashOffset = interpolate(0.0, distance, params.squashProgress);
+    const int gridResolution = params.gridResolution;
+    GridScales scales;
+    if (gridResolution) {
+        computeColumnScales(quads, gridResolution,
+            [&](qreal x) { return computeScale(x + squashOffset); }, scales);
+    }
+
+    int column = 0;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal leftOffset = quad[0].x() + squashOffset;
+        const qreal rightOffset = quad[2].x() + squashOffset;
+
+        qreal leftScale;
+        qreal rightScale;
+        if (gridResolution) {
+            leftScale = scales[column];
+            rightScale = scales[column + 1];
+            if (++column == gridResolution) {
+                column = 0;
+            }
+        } else {
+            leftScale = computeScale(leftOffset);
+            rightScale = computeScale(rightOffset);
+        }
+
+        const qreal targetTopLeftY = iconRect.y() + iconRect.height() * quad[0].y() / windowRect.height();
+        const qreal targetTopRightY = iconRect.y() + iconRect.height() * quad[1].y() / windowRect.height();
+        const qreal targetBottomRightY = iconRect.y() + iconRect.height() * quad[2].y() / windowRect.height();
+        const qreal targetBottomLeftY = iconRect.y() + iconRect.height() * quad[3].y() / windowRect.height();
+
+        quad[0].setY(quad[0].y() + leftScale * (targetTopLeftY - (windowRect.y() + quad[0].y())));
+        quad[3].setY(quad[3].y() + leftScale * (targetBottomLeftY - (windowRect.y() + quad[3].y())));
+        quad[1].setY(quad[1].y() + rightScale * (targetTopRightY - (windowRect.y() + quad[1].y())));
+        quad[2].setY(quad[2].y() + rightScale * (targetBottomRightY - (windowRect.y() + quad[2].y())));
+
+        const qreal targetLeftOffset = leftOffset - params.bumpDistance * params.bumpProgress;
+        const qreal targetRightOffset = rightOffset - params.bumpDistance * params.bumpProgress;
+
+        quad[0].setX(targetLeftOffset);
+        quad[3].setX(targetLeftOffset);
+        quad[1].setX(targetRightOffset);
+        quad[2].setX(targetRightOffset);
+    }
+}
+
+static void transformQuadsBottom(
+    const Model::Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    // FIXME: Have a generic function that transforms window quads. Perhaps,
+    // a better approach is to have a transform method that operates on each
+    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
+
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = iconRect.top() - windowRect.top() + params.bumpDistance;
+
+    const auto computeScale = [&](qreal offset) {
+        return params.stretchProgress * params.shapeCurve->valueForProgress(offset / distance);
+    };
+
+    // The shape curve is evaluated once per row of the grid instead of
+    // once per quad.
+    const qreal squashOffset = interpolate(0.0, distance, params.squashProgress);
+    const int gridResolution = params.gridResolution;
+    GridScales scales;
+    if (gridResolution) {
+        computeRowScales(quads, gridResolution,
+            [&](qreal y) { return computeScale(y + squashOffset); }, scales);
+    }
+
+    int row = 0;
+    int column = 0;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal topOffset = quad[0].y() + squashOffset;
+        const qreal bottomOffset = quad[2].y() + squashOffset;
+
+        qreal topScale;
+        qreal bottomScale;
+        if (gridResolution) {
+            topScale = scales[row];
+            bottomScale = scales[row + 1];
+            if (++column == gridResolution) {
+                column = 0;
+                ++row;
+            }
+        } else {
+            topScale = computeScale(topOffset);
+            bottomScale = computeScale(bottomOffset);
+        }
+
+        const qreal targetTopLeftX = iconRect.x() + iconRect.width() * quad[0].x() / windowRect.width();
+        const qreal targetTopRightX = iconRect.x() + iconRect.width() * quad[1].x() / windowRect.width();
+        const qreal targetBottomRightX = iconRect.x() + iconRect.width() * quad[2].x() / windowRect.width();
+        const qreal targetBottomLeftX = iconRect.x() + iconRect.width() * quad[3].x() / windowRect.width();
+
+        quad[0].setX(quad[0].x() + topScale * (targetTopLeftX - (windowRect.x() + quad[0].x())));
+        quad[1].setX(quad[1].x() + topScale * (targetTopRightX - (windowRect.x() + quad[1].x())));
+        quad[2].setX(quad[2].x() + bottomScale * (targetBottomRightX - (windowRect.x() + quad[2].x())));
+        quad[3].setX(quad[3].x() + bottomScale * (targetBottomLeftX - (windowRect.x() + quad[3].x())));
+
+        const qreal targetTopOffset = topOffset - params.bumpDistance * params.bumpProgress;
+        const qreal targetBottomOffset = bottomOffset - params.bumpDistance * params.bumpProgress;
+
+        quad[0].setY(targetTopOffset);
+        quad[1].setY(targetTopOffset);
+        quad[2].setY(targetBottomOffset);
+        quad[3].setY(targetBottomOffset);
+    }
+}
+
+void transformQuads(
+    const Model::Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    switch (params.direction) {
+    case Direction::Left:
+        transformQuadsLeft(geometry, params, quads);
+        break;
+
+    case Direction::Top:
+        transformQuadsTop(geometry, params, quads);
+        break;
+
+    case Direction::Right:
+        transformQuadsRight(geometry, params, quads);
+        break;
+
+    case Direction::Bottom:
+        transformQuadsBottom(geometry, params, quads);
+        break;
+
+    default:
+        Q_UNREACHABLE();
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Own
+#include "Model.h"
+
+/**
+ * Parameters of the mesh transformation for a single frame.
+ **/
+struct TransformParameters {
+    // Not owned, copying the curve would allocate on every frame.
+    const QEasingCurve* shapeCurve;
+    Direction direction;
+    qreal stretchProgress;
+    qreal squashProgress;
+    qreal bumpProgress;
+    qreal bumpDistance;
+    // Number of rows and columns if the quads form a row-major grid, as
+    // built by the model, or 0 otherwise.
+    int gridResolution;
+};
+
+/**
+ * Deforms the given window quads towards the icon. The quads are in the
+ * window coordinate space.
+ *
+ * The output of this function is checked against a frozen reference by
+ * the yaml-kernelcheck tool. Run it after changing the transformation.
+ **/
+void transformQuads(
+    const Model::Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads);
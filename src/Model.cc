@@ -17,7 +17,12 @@
 
 // Own
 #include "Model.h"
-#include "WindowQuad.h"
+#include "DockIndex.h"
+#include "MeshKernels.h"
+#include "Tracepoints.h"
+
+// The serial of the most recently built mesh of any model.
+static quint64 s_lastMeshSerial = 0;
 
 static inline std::chrono::milliseconds durationFraction(std::chrono::milliseconds duration, qreal fraction)
 {
@@ -29,54 +34,22 @@ Model::Model(KWin::EffectWindow* window)
 {
 }
 
-static KWin::EffectWindow* findDock(const KWin::EffectWindow* client)
-{
-    const KWin::EffectWindowList windows = KWin::effects->stackingOrder();
-
-    for (KWin::EffectWindow* window : windows) {
-        if (!window->isDock())
-            continue;
-
-        if (!window->geometry().intersects(client->iconGeometry()))
-            continue;
-
-        return window;
-    }
-
-    return nullptr;
-}
-
-static Direction realizeDirection(const KWin::EffectWindow* window)
+static Direction realizeDirection(const Model::Geometry& geometry, const DockIndex* dockIndex)
 {
-    const KWin::EffectWindow* dock = findDock(window);
+    const DockIndex::Dock* dock = dockIndex->findDock(geometry.iconRect);
 
     Direction direction;
     QPoint screenDelta;
 
     if (dock) {
-        const QRect screenRect = KWin::effects->clientArea(KWin::ScreenArea, dock);
-
-        if (dock->width() >= dock->height()) {
-            if (dock->y() == screenRect.y())
-                direction = Direction::Top;
-            else
-                direction = Direction::Bottom;
-        } else {
-            if (dock->x() == screenRect.x())
-                direction = Direction::Left;
-            else
-                direction = Direction::Right;
-        }
-
-        screenDelta += screenRect.center();
+        direction = dock->edge;
+        screenDelta += dock->screenRect.center();
     } else {
         // Perhaps the dock is hidden, deduce direction to the icon.
-        const QRect iconRect = window->iconGeometry();
+        const QRect iconRect = geometry.iconRect;
 
         const int screen = KWin::effects->screenNumber(iconRect.center());
-        const int desktop = KWin::effects->currentDesktop();
-
-        const QRect screenRect = KWin::effects->clientArea(KWin::ScreenArea, screen, desktop);
+        const QRect screenRect = dockIndex->screenArea(screen);
         const QRect constrainedRect = screenRect.intersected(iconRect);
 
         if (constrainedRect.left() == screenRect.left())
@@ -91,8 +64,7 @@ static Direction realizeDirection(const KWin::EffectWindow* window)
         screenDelta += screenRect.center();
     }
 
-    const QRect screenRect = KWin::effects->clientArea(KWin::ScreenArea, window);
-    screenDelta -= screenRect.center();
+    screenDelta -= geometry.screenRect.center();
 
     // Dock and window are on the same screen, no further adjustments are required.
     if (screenDelta.isNull())
@@ -136,14 +108,30 @@ void Model::start(AnimationKind kind)
 {
     m_kind = kind;
 
-    if (m_timeLine.running()) {
+    // Reverse the animation in place while it's in progress. At the start of
+    // a stage the timeline hasn't advanced yet, so the reversed stage is
+    // already complete and the animation moves on with the next step.
+    if (!m_done) {
+        const bool atStageStart = m_timeLine.elapsed() == std::chrono::milliseconds::zero();
         m_timeLine.toggleDirection();
+        if (atStageStart) {
+            m_timeLine.update(m_timeLine.duration());
+        }
+        YAML_TRACE4(animation_reverse, m_window, static_cast<int>(m_kind),
+            static_cast<int>(m_stage), qRound(m_timeLine.value() * 1000));
         return;
     }
 
-    m_direction = realizeDirection(m_window);
+    if (m_window) {
+        captureGeometry();
+        m_geometry.direction = realizeDirection(m_geometry, m_dockIndex);
+    }
+
     m_bumpDistance = computeBumpDistance();
     m_shapeFactor = computeShapeFactor();
+    m_clipRegion = computeClipRect();
+    m_meshValid = false;
+    m_done = false;
 
     switch (m_kind) {
     case AnimationKind::Minimize:
@@ -177,26 +165,54 @@ void Model::start(AnimationKind kind)
     default:
         Q_UNREACHABLE();
     }
+
+    YAML_TRACE4(animation_start, m_window, static_cast<int>(m_kind),
+        static_cast<int>(m_stage), qRound(m_timeLine.value() * 1000));
+}
+
+Model::AnimationKind Model::kind() const
+{
+    return m_kind;
 }
 
 void Model::step(std::chrono::milliseconds delta)
 {
-    m_timeLine.update(delta);
-    if (!m_timeLine.done()) {
-        return;
-    }
+    // The time left over after the current stage is complete is carried over
+    // to the next stage, so a late frame may advance the animation through
+    // several stages at once and the animation still finishes on time.
+    while (!m_done) {
+        const std::chrono::milliseconds remaining = m_timeLine.duration() - m_timeLine.elapsed();
+
+        m_timeLine.update(delta);
+        if (!m_timeLine.done()) {
+            return;
+        }
 
-    switch (m_kind) {
-    case AnimationKind::Minimize:
-        updateMinimizeStage();
-        break;
+        switch (m_kind) {
+        case AnimationKind::Minimize:
+            updateMinimizeStage();
+            break;
 
-    case AnimationKind::Unminimize:
-        updateUnminimizeStage();
-        break;
+        case AnimationKind::Unminimize:
+            updateUnminimizeStage();
+            break;
 
-    default:
-        Q_UNREACHABLE();
+        default:
+            Q_UNREACHABLE();
+        }
+
+        if (m_done) {
+            YAML_TRACE2(animation_finish, m_window, static_cast<int>(m_kind));
+            return;
+        }
+
+        YAML_TRACE4(stage_transition, m_window, static_cast<int>(m_kind),
+            static_cast<int>(m_stage), qRound(m_timeLine.value() * 1000));
+
+        if (delta <= remaining) {
+            return;
+        }
+        delta -= remaining;
     }
 }
 
@@ -280,286 +296,291 @@ bool Model::done() const
     return m_done;
 }
 
-struct TransformParameters {
-    QEasingCurve shapeCurve;
-    Direction direction;
-    qreal stretchProgress;
-    qreal squashProgress;
-    qreal bumpProgress;
-    qreal bumpDistance;
-};
-
-static inline qreal interpolate(qreal from, qreal to, qreal t)
+void Model::captureGeometry()
 {
-    return from * (1.0 - t) + to * t;
+    m_geometry.windowRect = m_window->geometry();
+    m_geometry.expandedRect = m_parameters.excludeShadows
+        ? m_geometry.windowRect
+        : m_window->expandedGeometry();
+    m_geometry.iconRect = m_window->iconGeometry();
+    m_geometry.screenRect = m_dockIndex->screenArea(
+        KWin::effects->screenNumber(m_geometry.windowRect.center()));
 }
 
-static void transformQuadsLeft(
-    const KWin::EffectWindow* window,
-    const TransformParameters& params,
-    QVector<WindowQuad>& quads)
+void Model::apply(QVector<WindowQuad>& quads) const
 {
-    // FIXME: Have a generic function that transforms window quads. Perhaps,
-    // a better approach is to have a transform method that operates on each
-    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
-
-    const QRect iconRect = window->iconGeometry();
-    const QRect windowRect = window->geometry();
-
-    const qreal distance = windowRect.right() - iconRect.right() + params.bumpDistance;
-
-    for (int i = 0; i < quads.count(); ++i) {
-        WindowQuad& quad = quads[i];
-
-        const qreal leftOffset = quad[0].x() - interpolate(0.0, distance, params.squashProgress);
-        const qreal rightOffset = quad[2].x() - interpolate(0.0, distance, params.squashProgress);
-
-        const qreal leftScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.width() - leftOffset) / distance);
-        const qreal rightScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.width() - rightOffset) / distance);
-
-        const qreal targetTopLeftY = iconRect.y() + iconRect.height() * quad[0].y() / windowRect.height();
-        const qreal targetTopRightY = iconRect.y() + iconRect.height() * quad[1].y() / windowRect.height();
-        const qreal targetBottomRightY = iconRect.y() + iconRect.height() * quad[2].y() / windowRect.height();
-        const qreal targetBottomLeftY = iconRect.y() + iconRect.height() * quad[3].y() / windowRect.height();
-
-        quad[0].setY(quad[0].y() + leftScale * (targetTopLeftY - (windowRect.y() + quad[0].y())));
-        quad[3].setY(quad[3].y() + leftScale * (targetBottomLeftY - (windowRect.y() + quad[3].y())));
-        quad[1].setY(quad[1].y() + rightScale * (targetTopRightY - (windowRect.y() + quad[1].y())));
-        quad[2].setY(quad[2].y() + rightScale * (targetBottomRightY - (windowRect.y() + quad[2].y())));
-
-        const qreal targetLeftOffset = leftOffset + params.bumpDistance * params.bumpProgress;
-        const qreal targetRightOffset = rightOffset + params.bumpDistance * params.bumpProgress;
-
-        quad[0].setX(targetLeftOffset);
-        quad[3].setX(targetLeftOffset);
-        quad[1].setX(targetRightOffset);
-        quad[2].setX(targetRightOffset);
-    }
+    // The quads may come from anywhere, so don't assume they form a grid.
+    deform(quads, 0);
 }
 
-static void transformQuadsTop(
-    const KWin::EffectWindow* window,
-    const TransformParameters& params,
-    QVector<WindowQuad>& quads)
+void Model::apply(KWin::WindowQuadList& quads)
 {
-    // FIXME: Have a generic function that transforms window quads. Perhaps,
-    // a better approach is to have a transform method that operates on each
-    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
-
-    const QRect iconRect = window->iconGeometry();
-    const QRect windowRect = window->geometry();
-
-    const qreal distance = windowRect.bottom() - iconRect.bottom() + params.bumpDistance;
-
+    // The buffer is kept around so its storage is reused between frames.
+    m_windowQuads.resize(quads.count());
     for (int i = 0; i < quads.count(); ++i) {
-        WindowQuad& quad = quads[i];
-
-        const qreal topOffset = quad[0].y() - interpolate(0.0, distance, params.squashProgress);
-        const qreal bottomOffset = quad[2].y() - interpolate(0.0, distance, params.squashProgress);
-
-        const qreal topScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.height() - topOffset) / distance);
-        const qreal bottomScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.height() - bottomOffset) / distance);
-
-        const qreal targetTopLeftX = iconRect.x() + iconRect.width() * quad[0].x() / windowRect.width();
-        const qreal targetTopRightX = iconRect.x() + iconRect.width() * quad[1].x() / windowRect.width();
-        const qreal targetBottomRightX = iconRect.x() + iconRect.width() * quad[2].x() / windowRect.width();
-        const qreal targetBottomLeftX = iconRect.x() + iconRect.width() * quad[3].x() / windowRect.width();
-
-        quad[0].setX(quad[0].x() + topScale * (targetTopLeftX - (windowRect.x() + quad[0].x())));
-        quad[1].setX(quad[1].x() + topScale * (targetTopRightX - (windowRect.x() + quad[1].x())));
-        quad[2].setX(quad[2].x() + bottomScale * (targetBottomRightX - (windowRect.x() + quad[2].x())));
-        quad[3].setX(quad[3].x() + bottomScale * (targetBottomLeftX - (windowRect.x() + quad[3].x())));
+        for (int j = 0; j < 4; ++j) {
+            m_windowQuads[i][j].setX(quads[i][j].x());
+            m_windowQuads[i][j].setY(quads[i][j].y());
+        }
+    }
 
-        const qreal targetTopOffset = topOffset + params.bumpDistance * params.bumpProgress;
-        const qreal targetBottomOffset = bottomOffset + params.bumpDistance * params.bumpProgress;
+    apply(m_windowQuads);
 
-        quad[0].setY(targetTopOffset);
-        quad[1].setY(targetTopOffset);
-        quad[2].setY(targetBottomOffset);
-        quad[3].setY(targetBottomOffset);
+    for (int i = 0; i < quads.count(); ++i) {
+        for (int j = 0; j < 4; ++j) {
+            quads[i][j].setX(m_windowQuads[i][j].x());
+            quads[i][j].setY(m_windowQuads[i][j].y());
+        }
     }
 }
 
-static void transformQuadsRight(
-    const KWin::EffectWindow* window,
-    const TransformParameters& params,
-    QVector<WindowQuad>& quads)
+const QVector<WindowQuad>& Model::mesh(int gridResolution)
 {
-    // FIXME: Have a generic function that transforms window quads. Perhaps,
-    // a better approach is to have a transform method that operates on each
-    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
-
-    const QRect iconRect = window->iconGeometry();
-    const QRect windowRect = window->geometry();
-
-    const qreal distance = iconRect.left() - windowRect.left() + params.bumpDistance;
+    // Make room for the full grid up front, so that the mesh isn't
+    // reallocated when the bump stage is over.
+    m_mesh.reserve(gridResolution * gridResolution);
+
+    // The bump stage doesn't deform the window, it's translated instead.
+    const bool translationOnly = m_stage == AnimationStage::Bump;
+    if (translationOnly) {
+        gridResolution = 1;
+    }
 
-    for (int i = 0; i < quads.count(); ++i) {
-        WindowQuad& quad = quads[i];
+    const qreal progress = translationOnly ? 0.0 : m_timeLine.value();
 
-        const qreal leftOffset = quad[0].x() + interpolate(0.0, distance, params.squashProgress);
-        const qreal rightOffset = quad[2].x() + interpolate(0.0, distance, params.squashProgress);
+    if (m_meshValid
+        && m_meshKey.stage == m_stage
+        && m_meshKey.progress == progress
+        && m_meshKey.gridResolution == gridResolution
+        && m_meshKey.windowRect == m_geometry.windowRect
+        && m_meshKey.expandedRect == m_geometry.expandedRect
+        && m_meshKey.iconRect == m_geometry.iconRect) {
+        return m_mesh;
+    }
 
-        const qreal leftScale = params.stretchProgress * params.shapeCurve.valueForProgress(leftOffset / distance);
-        const qreal rightScale = params.stretchProgress * params.shapeCurve.valueForProgress(rightOffset / distance);
+    YAML_TRACE4(mesh_deform_begin, m_window, static_cast<int>(m_stage),
+        qRound(progress * 1000), gridResolution * gridResolution);
 
-        const qreal targetTopLeftY = iconRect.y() + iconRect.height() * quad[0].y() / windowRect.height();
-        const qreal targetTopRightY = iconRect.y() + iconRect.height() * quad[1].y() / windowRect.height();
-        const qreal targetBottomRightY = iconRect.y() + iconRect.height() * quad[2].y() / windowRect.height();
-        const qreal targetBottomLeftY = iconRect.y() + iconRect.height() * quad[3].y() / windowRect.height();
+    makeGrid(gridResolution);
+    if (!translationOnly) {
+        deform(m_mesh, gridResolution);
+    }
+    if (m_clip) {
+        cullMesh();
+    }
 
-        quad[0].setY(quad[0].y() + leftScale * (targetTopLeftY - (windowRect.y() + quad[0].y())));
-        quad[3].setY(quad[3].y() + leftScale * (targetBottomLeftY - (windowRect.y() + quad[3].y())));
-        quad[1].setY(quad[1].y() + rightScale * (targetTopRightY - (windowRect.y() + quad[1].y())));
-        quad[2].setY(quad[2].y() + rightScale * (targetBottomRightY - (windowRect.y() + quad[2].y())));
+    YAML_TRACE4(mesh_deform_end, m_window, static_cast<int>(m_stage),
+        qRound(progress * 1000), m_mesh.count());
 
-        const qreal targetLeftOffset = leftOffset - params.bumpDistance * params.bumpProgress;
-        const qreal targetRightOffset = rightOffset - params.bumpDistance * params.bumpProgress;
+    m_meshKey.stage = m_stage;
+    m_meshKey.progress = progress;
+    m_meshKey.gridResolution = gridResolution;
+    m_meshKey.windowRect = m_geometry.windowRect;
+    m_meshKey.expandedRect = m_geometry.expandedRect;
+    m_meshKey.iconRect = m_geometry.iconRect;
+    m_meshValid = true;
+    m_meshSerial = ++s_lastMeshSerial;
 
-        quad[0].setX(targetLeftOffset);
-        quad[3].setX(targetLeftOffset);
-        quad[1].setX(targetRightOffset);
-        quad[2].setX(targetRightOffset);
-    }
+    return m_mesh;
 }
 
-static void transformQuadsBottom(
-    const KWin::EffectWindow* window,
-    const TransformParameters& params,
-    QVector<WindowQuad>& quads)
+quint64 Model::meshSerial() const
 {
-    // FIXME: Have a generic function that transforms window quads. Perhaps,
-    // a better approach is to have a transform method that operates on each
-    // individual vertex, e.g. void Model::transform(WindowVertex& vertex).
-
-    const QRect iconRect = window->iconGeometry();
-    const QRect windowRect = window->geometry();
-
-    const qreal distance = iconRect.top() - windowRect.top() + params.bumpDistance;
-
-    for (int i = 0; i < quads.count(); ++i) {
-        WindowQuad& quad = quads[i];
-
-        const qreal topOffset = quad[0].y() + interpolate(0.0, distance, params.squashProgress);
-        const qreal bottomOffset = quad[2].y() + interpolate(0.0, distance, params.squashProgress);
-
-        const qreal topScale = params.stretchProgress * params.shapeCurve.valueForProgress(topOffset / distance);
-        const qreal bottomScale = params.stretchProgress * params.shapeCurve.valueForProgress(bottomOffset / distance);
-
-        const qreal targetTopLeftX = iconRect.x() + iconRect.width() * quad[0].x() / windowRect.width();
-        const qreal targetTopRightX = iconRect.x() + iconRect.width() * quad[1].x() / windowRect.width();
-        const qreal targetBottomRightX = iconRect.x() + iconRect.width() * quad[2].x() / windowRect.width();
-        const qreal targetBottomLeftX = iconRect.x() + iconRect.width() * quad[3].x() / windowRect.width();
+    return m_meshSerial;
+}
 
-        quad[0].setX(quad[0].x() + topScale * (targetTopLeftX - (windowRect.x() + quad[0].x())));
-        quad[1].setX(quad[1].x() + topScale * (targetTopRightX - (windowRect.x() + quad[1].x())));
-        quad[2].setX(quad[2].x() + bottomScale * (targetBottomRightX - (windowRect.x() + quad[2].x())));
-        quad[3].setX(quad[3].x() + bottomScale * (targetBottomLeftX - (windowRect.x() + quad[3].x())));
+void Model::cullMesh()
+{
+    // The mesh is in the window coordinate space.
+    const QRectF clipRect = computeClipRect().translated(-m_geometry.windowRect.topLeft());
+
+    int count = 0;
+    for (int i = 0; i < m_mesh.count(); ++i) {
+        const WindowQuad& quad = m_mesh[i];
+
+        qreal left = quad[0].x();
+        qreal right = quad[0].x();
+        qreal top = quad[0].y();
+        qreal bottom = quad[0].y();
+        for (int j = 1; j < 4; ++j) {
+            left = qMin(left, quad[j].x());
+            right = qMax(right, quad[j].x());
+            top = qMin(top, quad[j].y());
+            bottom = qMax(bottom, quad[j].y());
+        }
 
-        const qreal targetTopOffset = topOffset - params.bumpDistance * params.bumpProgress;
-        const qreal targetBottomOffset = bottomOffset - params.bumpDistance * params.bumpProgress;
+        // Quads that have collapsed or have been fully clipped are invisible.
+        if (left >= right || top >= bottom) {
+            continue;
+        }
+        if (right <= clipRect.left() || left >= clipRect.right()) {
+            continue;
+        }
+        if (bottom <= clipRect.top() || top >= clipRect.bottom()) {
+            continue;
+        }
 
-        quad[0].setY(targetTopOffset);
-        quad[1].setY(targetTopOffset);
-        quad[2].setY(targetBottomOffset);
-        quad[3].setY(targetBottomOffset);
+        if (count != i) {
+            m_mesh[count] = quad;
+        }
+        ++count;
     }
+
+    m_mesh.resize(count);
 }
 
-static void transformQuads(
-    const KWin::EffectWindow* window,
-    const TransformParameters& params,
-    QVector<WindowQuad>& quads)
+QPointF Model::translation() const
 {
-    switch (params.direction) {
+    if (m_stage != AnimationStage::Bump) {
+        return QPointF();
+    }
+
+    const qreal distance = m_bumpDistance * m_timeLine.value();
+
+    switch (m_geometry.direction) {
     case Direction::Left:
-        transformQuadsLeft(window, params, quads);
-        break;
+        return QPointF(distance, 0.0);
 
     case Direction::Top:
-        transformQuadsTop(window, params, quads);
-        break;
+        return QPointF(0.0, distance);
 
     case Direction::Right:
-        transformQuadsRight(window, params, quads);
-        break;
+        return QPointF(-distance, 0.0);
 
     case Direction::Bottom:
-        transformQuadsBottom(window, params, quads);
-        break;
+        return QPointF(0.0, -distance);
 
     default:
         Q_UNREACHABLE();
     }
 }
 
-void Model::apply(QVector<WindowQuad>& quads) const
+void Model::makeGrid(int gridResolution)
+{
+    // The mesh is rebuilt in place so its storage is reused between frames.
+    m_mesh.resize(gridResolution * gridResolution);
+
+    const QRectF geometry = m_geometry.windowRect;
+    const QRectF expandedGeometry = m_geometry.expandedRect;
+
+    const qreal initialX = expandedGeometry.x() - geometry.x();
+    const qreal initialY = expandedGeometry.y() - geometry.y();
+    const qreal initialU = 0.0;
+    const qreal initialV = 0.0;
+
+    const qreal dx = expandedGeometry.width() / gridResolution;
+    const qreal dy = expandedGeometry.height() / gridResolution;
+    const qreal du = 1.0 / gridResolution;
+    const qreal dv = 1.0 / gridResolution;
+
+    WindowQuad* quad = m_mesh.data();
+
+    qreal y = initialY;
+    qreal v = initialV;
+    for (int i = 0; i < gridResolution; ++i) {
+        qreal x = initialX;
+        qreal u = initialU;
+        for (int j = 0; j < gridResolution; ++j) {
+            (*quad)[0].setX(x);
+            (*quad)[0].setY(y);
+            (*quad)[0].setU(u);
+            (*quad)[0].setV(v);
+
+            (*quad)[1].setX(x + dx);
+            (*quad)[1].setY(y);
+            (*quad)[1].setU(u + du);
+            (*quad)[1].setV(v);
+
+            (*quad)[2].setX(x + dx);
+            (*quad)[2].setY(y + dy);
+            (*quad)[2].setU(u + du);
+            (*quad)[2].setV(v + dv);
+
+            (*quad)[3].setX(x);
+            (*quad)[3].setY(y + dy);
+            (*quad)[3].setU(u);
+            (*quad)[3].setV(v + dv);
+
+            ++quad;
+            x += dx;
+            u += du;
+        }
+        y += dy;
+        v += dv;
+    }
+}
+
+void Model::deform(QVector<WindowQuad>& quads, int gridResolution) const
 {
     switch (m_stage) {
     case AnimationStage::Bump:
-        applyBump(quads);
+        applyBump(quads, gridResolution);
         break;
 
     case AnimationStage::Stretch1:
-        applyStretch1(quads);
+        applyStretch1(quads, gridResolution);
         break;
 
     case AnimationStage::Stretch2:
-        applyStretch2(quads);
+        applyStretch2(quads, gridResolution);
         break;
 
     case AnimationStage::Squash:
-        applySquash(quads);
+        applySquash(quads, gridResolution);
         break;
     }
 }
 
-void Model::applyBump(QVector<WindowQuad>& quads) const
+void Model::applyBump(QVector<WindowQuad>& quads, int gridResolution) const
 {
     TransformParameters params;
-    params.shapeCurve = m_parameters.shapeCurve;
-    params.direction = m_direction;
+    params.shapeCurve = &m_parameters.shapeCurve;
+    params.direction = m_geometry.direction;
     params.squashProgress = 0.0;
     params.stretchProgress = 0.0;
     params.bumpProgress = m_timeLine.value();
     params.bumpDistance = m_bumpDistance;
-    transformQuads(m_window, params, quads);
+    params.gridResolution = gridResolution;
+    transformQuads(m_geometry, params, quads);
 }
 
-void Model::applyStretch1(QVector<WindowQuad>& quads) const
+void Model::applyStretch1(QVector<WindowQuad>& quads, int gridResolution) const
 {
     TransformParameters params;
-    params.shapeCurve = m_parameters.shapeCurve;
-    params.direction = m_direction;
+    params.shapeCurve = &m_parameters.shapeCurve;
+    params.direction = m_geometry.direction;
     params.squashProgress = 0.0;
     params.stretchProgress = m_shapeFactor * m_timeLine.value();
     params.bumpProgress = 1.0;
     params.bumpDistance = m_bumpDistance;
-    transformQuads(m_window, params, quads);
+    params.gridResolution = gridResolution;
+    transformQuads(m_geometry, params, quads);
 }
 
-void Model::applyStretch2(QVector<WindowQuad>& quads) const
+void Model::applyStretch2(QVector<WindowQuad>& quads, int gridResolution) const
 {
     TransformParameters params;
-    params.shapeCurve = m_parameters.shapeCurve;
-    params.direction = m_direction;
+    params.shapeCurve = &m_parameters.shapeCurve;
+    params.direction = m_geometry.direction;
     params.squashProgress = 0.0;
     params.stretchProgress = m_shapeFactor * m_timeLine.value();
     params.bumpProgress = params.stretchProgress;
     params.bumpDistance = m_bumpDistance;
-    transformQuads(m_window, params, quads);
+    params.gridResolution = gridResolution;
+    transformQuads(m_geometry, params, quads);
 }
 
-void Model::applySquash(QVector<WindowQuad>& quads) const
+void Model::applySquash(QVector<WindowQuad>& quads, int gridResolution) const
 {
     TransformParameters params;
-    params.shapeCurve = m_parameters.shapeCurve;
-    params.direction = m_direction;
+    params.shapeCurve = &m_parameters.shapeCurve;
+    params.direction = m_geometry.direction;
     params.squashProgress = m_timeLine.value();
     params.stretchProgress = qMin(m_shapeFactor + params.squashProgress, 1.0);
     params.bumpProgress = 1.0;
     params.bumpDistance = m_bumpDistance;
-    transformQuads(m_window, params, quads);
+    params.gridResolution = gridResolution;
+    transformQuads(m_geometry, params, quads);
 }
 
 Model::Parameters Model::parameters() const
@@ -572,6 +593,41 @@ void Model::setParameters(const Parameters& parameters)
     m_parameters = parameters;
 }
 
+Model::Geometry Model::geometry() const
+{
+    return m_geometry;
+}
+
+void Model::setGeometry(const Geometry& geometry)
+{
+    m_geometry = geometry;
+}
+
+void Model::updateGeometry()
+{
+    if (!m_window) {
+        return;
+    }
+
+    captureGeometry();
+
+    // Everything derived from the snapshot in start() has to follow it.
+    m_bumpDistance = computeBumpDistance();
+    m_shapeFactor = computeShapeFactor();
+    m_clipRegion = computeClipRect();
+    m_meshValid = false;
+}
+
+const DockIndex* Model::dockIndex() const
+{
+    return m_dockIndex;
+}
+
+void Model::setDockIndex(const DockIndex* dockIndex)
+{
+    m_dockIndex = dockIndex;
+}
+
 KWin::EffectWindow* Model::window() const
 {
     return m_window;
@@ -589,10 +645,38 @@ bool Model::needsClip() const
 
 QRegion Model::clipRegion() const
 {
-    const QRect iconRect = m_window->iconGeometry();
-    QRect clipRect = m_window->expandedGeometry();
+    // The clip rect changes rarely, so the region is kept around instead of
+    // being allocated on every frame.
+    const QRect clipRect = computeClipRect();
+    if (m_clipRegion.boundingRect() != clipRect) {
+        m_clipRegion = clipRect;
+    }
+    return m_clipRegion;
+}
+
+QRect Model::clipRect() const
+{
+    return computeClipRect();
+}
+
+QRect Model::boundingRect() const
+{
+    const QRect clipRect = computeClipRect();
+    if (m_clip) {
+        return clipRect;
+    }
+
+    // The clip rect spans from the raised window to the icon, the window
+    // itself is only outside of it before being raised.
+    return clipRect | m_geometry.expandedRect;
+}
+
+QRect Model::computeClipRect() const
+{
+    const QRect iconRect = m_geometry.iconRect;
+    QRect clipRect = m_geometry.expandedRect;
 
-    switch (m_direction) {
+    switch (m_geometry.direction) {
     case Direction::Top:
         clipRect.translate(0, m_bumpDistance);
         clipRect.setTop(iconRect.top());
@@ -630,11 +714,11 @@ QRegion Model::clipRegion() const
 
 int Model::computeBumpDistance() const
 {
-    const QRect windowRect = m_window->geometry();
-    const QRect iconRect = m_window->iconGeometry();
+    const QRect windowRect = m_geometry.windowRect;
+    const QRect iconRect = m_geometry.iconRect;
 
     int bumpDistance = 0;
-    switch (m_direction) {
+    switch (m_geometry.direction) {
     case Direction::Top:
         bumpDistance = qMax(0, iconRect.y() + iconRect.height() - windowRect.y());
         break;
@@ -662,12 +746,12 @@ int Model::computeBumpDistance() const
 
 qreal Model::computeShapeFactor() const
 {
-    const QRect windowRect = m_window->geometry();
-    const QRect iconRect = m_window->iconGeometry();
+    const QRect windowRect = m_geometry.windowRect;
+    const QRect iconRect = m_geometry.iconRect;
 
     int movingExtent = 0;
     int distanceToIcon = 0;
-    switch (m_direction) {
+    switch (m_geometry.direction) {
     case Direction::Top:
         movingExtent = windowRect.height();
         distanceToIcon = windowRect.bottom() - iconRect.bottom() + m_bumpDistance;
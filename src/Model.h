@@ -18,6 +18,7 @@
 #pragma once
 
 // Own
+#include "WindowQuad.h"
 #include "common.h"
 
 // kwineffects
@@ -27,7 +28,7 @@
 #include "hacks/TimeLine.h"
 #endif
 
-class WindowQuad;
+class DockIndex;
 
 /**
  * Model for the magic lamp animation.
@@ -52,6 +53,29 @@ public:
 
         // How much the transformed window should be raised.
         int bumpDistance;
+
+        // Whether the shadow of the window is left out of the animation.
+        bool excludeShadows;
+    };
+
+    /**
+     * Snapshot of the geometry that the animation operates on.
+     **/
+    struct Geometry {
+        // The frame geometry of the window.
+        QRect windowRect;
+
+        // The geometry of the window including its shadow.
+        QRect expandedRect;
+
+        // The geometry of the icon the window is minimized to.
+        QRect iconRect;
+
+        // The geometry of the screen the window is on.
+        QRect screenRect;
+
+        // The direction in which the window approaches the icon.
+        Direction direction = Direction::Bottom;
     };
 
     explicit Model(KWin::EffectWindow* window = nullptr);
@@ -71,13 +95,20 @@ public:
      **/
     void start(AnimationKind kind);
 
+    /**
+     * Returns the kind of the current animation.
+     **/
+    AnimationKind kind() const;
+
     /**
      * Updates the model by @p delta milliseconds.
      **/
     void step(std::chrono::milliseconds delta);
 
     /**
-     * Returns whether the animation is complete.
+     * Returns whether the animation is complete. A model that has not been
+     * started yet is complete too. Starting an animation that is not
+     * complete reverses it.
      **/
     bool done() const;
 
@@ -89,6 +120,40 @@ public:
      **/
     void apply(QVector<WindowQuad>& quads) const;
 
+    /**
+     * Applies the current state of the model to the given list of KWin
+     * window quads. Only the positions of vertices are changed.
+     *
+     * @param quads The list of window quads to be transformed.
+     **/
+    void apply(KWin::WindowQuadList& quads);
+
+    /**
+     * Returns the transformed mesh for the current state of the model. The
+     * mesh is rebuilt only if the stage, the progress or the geometry of the
+     * model have changed since the last call.
+     *
+     * @param gridResolution The number of rows and columns in the mesh.
+     **/
+    const QVector<WindowQuad>& mesh(int gridResolution);
+
+    /**
+     * Returns the serial of the mesh returned by the last call to mesh().
+     * The serial changes whenever the mesh is rebuilt and is never shared by
+     * meshes of different models, so it can be used to cache data derived
+     * from the mesh.
+     **/
+    quint64 meshSerial() const;
+
+    /**
+     * Returns the translation that has to be applied to the mesh when it's
+     * painted. During the bump stage the window is only translated, so its
+     * mesh is not deformed and doesn't change for the whole stage.
+     *
+     * @see mesh
+     **/
+    QPointF translation() const;
+
     /**
      * Returns the parameters of the model.
      **/
@@ -113,6 +178,39 @@ public:
      **/
     void setWindow(KWin::EffectWindow* window);
 
+    /**
+     * Returns the dock index used to find the direction to the icon.
+     **/
+    const DockIndex* dockIndex() const;
+
+    /**
+     * Sets the dock index used to find the direction to the icon. It must
+     * be set if the model has an associated window.
+     *
+     * @param dockIndex The dock index.
+     **/
+    void setDockIndex(const DockIndex* dockIndex);
+
+    /**
+     * Returns the geometry snapshot of the model.
+     **/
+    Geometry geometry() const;
+
+    /**
+     * Sets the geometry snapshot of the model. Models without an associated
+     * window are driven entirely by the geometry specified here.
+     *
+     * @param geometry The new geometry snapshot.
+     **/
+    void setGeometry(const Geometry& geometry);
+
+    /**
+     * Refreshes the geometry snapshot from the associated window. This has to
+     * be called whenever the geometry of the window changes. The direction of
+     * a running animation is preserved.
+     **/
+    void updateGeometry();
+
     /**
      * Returns whether the painted result has to be clipped.
      *
@@ -121,17 +219,38 @@ public:
     bool needsClip() const;
 
     /**
-     * Returns the clip region.
+     * Returns the clip region. The region is cached, so it's cheap to call
+     * this every frame.
      *
      * @see needsClip
      **/
     QRegion clipRegion() const;
 
+    /**
+     * Returns the clip rectangle. Unlike clipRegion(), this doesn't allocate.
+     *
+     * @see needsClip
+     **/
+    QRect clipRect() const;
+
+    /**
+     * Returns a conservative bounding rectangle of the painted result for the
+     * current stage of the animation.
+     **/
+    QRect boundingRect() const;
+
 private:
-    void applyBump(QVector<WindowQuad>& quads) const;
-    void applyStretch1(QVector<WindowQuad>& quads) const;
-    void applyStretch2(QVector<WindowQuad>& quads) const;
-    void applySquash(QVector<WindowQuad>& quads) const;
+    void deform(QVector<WindowQuad>& quads, int gridResolution) const;
+    void applyBump(QVector<WindowQuad>& quads, int gridResolution) const;
+    void applyStretch1(QVector<WindowQuad>& quads, int gridResolution) const;
+    void applyStretch2(QVector<WindowQuad>& quads, int gridResolution) const;
+    void applySquash(QVector<WindowQuad>& quads, int gridResolution) const;
+
+    void makeGrid(int gridResolution);
+    void cullMesh();
+
+    void captureGeometry();
+    QRect computeClipRect() const;
 
     void updateMinimizeStage();
     void updateUnminimizeStage();
@@ -149,12 +268,30 @@ private:
     };
 
     KWin::EffectWindow* m_window;
+    const DockIndex* m_dockIndex = nullptr;
     AnimationKind m_kind;
     AnimationStage m_stage;
     KWin::TimeLine m_timeLine;
-    Direction m_direction;
+    Geometry m_geometry;
     int m_bumpDistance;
     qreal m_shapeFactor;
     bool m_clip;
-    bool m_done = false;
+    bool m_done = true;
+
+    struct MeshKey {
+        AnimationStage stage;
+        qreal progress;
+        int gridResolution;
+        QRect windowRect;
+        QRect expandedRect;
+        QRect iconRect;
+    };
+
+    mutable QRegion m_clipRegion;
+
+    QVector<WindowQuad> m_mesh;
+    QVector<WindowQuad> m_windowQuads;
+    MeshKey m_meshKey;
+    bool m_meshValid = false;
+    quint64 m_meshSerial = 0;
 };
@@ -17,12 +17,25 @@
 
 // Own
 #include "OffscreenRenderer.h"
+#include "Tracepoints.h"
 
 // std
 #include <cmath>
 
 using namespace KWin;
 
+// The longest side of low resolution snapshots of minimized windows.
+static const int maximumSnapshotSize = 256;
+
+// How much memory the snapshots of minimized windows may occupy.
+static const qint64 snapshotMemoryBudget = 32 * 1024 * 1024;
+
+static qint64 textureMemory(const GLTexture *texture)
+{
+    // Four bytes per texel, plus a third for the mip chain.
+    return qint64(texture->width()) * texture->height() * 4 * 4 / 3;
+}
+
 /**
     \class OffscreenRenderer
     \brief Helper class to render windows into offscreen textures.
@@ -34,12 +47,9 @@ using namespace KWin;
 OffscreenRenderer::OffscreenRenderer(QObject *parent)
     : QObject(parent)
 {
-    connect(effects, &EffectsHandler::windowGeometryShapeChanged,
-            this, &OffscreenRenderer::slotWindowGeometryShapeChanged);
+    // Snapshots outlive registrations, so deleted windows are always tracked.
     connect(effects, &EffectsHandler::windowDeleted,
             this, &OffscreenRenderer::slotWindowDeleted);
-    connect(effects, &EffectsHandler::windowDamaged,
-            this, &OffscreenRenderer::slotWindowDamaged);
 }
 
 /*!
@@ -48,6 +58,7 @@ OffscreenRenderer::OffscreenRenderer(QObject *parent)
 OffscreenRenderer::~OffscreenRenderer()
 {
     unregisterAllWindows();
+    freeAllSnapshots();
 }
 
 /*!
@@ -58,9 +69,26 @@ void OffscreenRenderer::registerWindow(EffectWindow *window)
     if (m_renderResources.contains(window))
         return;
 
-    RenderResources resources = allocateRenderResources(window);
-    if (resources.isValid())
+    // Start with the low resolution snapshot of the window if there is one,
+    // the window is rendered in full resolution on a later frame. Snapshots
+    // of windows that have been resized since are stale.
+    Snapshot snapshot = takeSnapshot(window);
+    if (snapshot.texture && snapshot.windowSize != capturedGeometry(window).size()) {
+        delete snapshot.texture;
+        snapshot.texture = nullptr;
+    }
+
+    if (snapshot.texture) {
+        RenderResources resources;
+        resources.snapshot = snapshot.texture;
         m_renderResources[window] = resources;
+    } else {
+        RenderResources resources = allocateRenderResources(window);
+        if (resources.isValid())
+            m_renderResources[window] = resources;
+    }
+
+    updateSubscriptions();
 }
 
 /*!
@@ -74,6 +102,8 @@ void OffscreenRenderer::unregisterWindow(EffectWindow *window)
 
     freeRenderResources(*it);
     m_renderResources.erase(it);
+
+    updateSubscriptions();
 }
 
 /*!
@@ -87,7 +117,40 @@ void OffscreenRenderer::unregisterAllWindows()
 }
 
 /*!
-    Renders the given window into an offscreen texture.
+    Returns the offscreen texture of the given window for the current frame,
+    without updating its contents. Must be called before render() in every
+    frame, render() updates the returned texture.
+
+    If the window has been registered with a snapshot, the snapshot is
+    returned for the whole first frame, on every output, and the full
+    resolution texture is allocated on the next frame.
+*/
+GLTexture *OffscreenRenderer::prepare(EffectWindow *window)
+{
+    auto it = m_renderResources.find(window);
+    if (it == m_renderResources.end())
+        return nullptr;
+
+    if (!it->texture) {
+        if (!it->isSnapshotPresented) {
+            it->isSnapshotShown = true;
+            return it->snapshot;
+        }
+
+        RenderResources resources = allocateRenderResources(window);
+        if (!resources.isValid())
+            return it->snapshot;
+
+        freeRenderResources(*it);
+        *it = resources;
+    }
+
+    return it->texture;
+}
+
+/*!
+    Renders the given window into the offscreen texture returned by
+    prepare() in the current frame. Snapshots are never rendered into.
 */
 GLTexture *OffscreenRenderer::render(EffectWindow *window)
 {
@@ -95,9 +158,14 @@ GLTexture *OffscreenRenderer::render(EffectWindow *window)
     if (it == m_renderResources.end())
         return nullptr;
 
+    if (!it->texture)
+        return it->snapshot;
+
     if (!it->isDirty)
         return it->texture;
 
+    YAML_TRACE3(offscreen_render_begin, window, it->texture->width(), it->texture->height());
+
     GLRenderTarget::pushRenderTarget(it->renderTarget);
 
     glClearColor(0.0, 0.0, 0.0, 0.0);
@@ -107,22 +175,162 @@ GLTexture *OffscreenRenderer::render(EffectWindow *window)
 
     WindowPaintData data(window);
 
+#if KWIN_EFFECT_API_VERSION < KWIN_EFFECT_API_MAKE_VERSION(0, 233)
+    // Don't paint the shadow just to have it cut off by the viewport.
+    if (m_shadowsExcluded)
+        data.quads = data.quads.filterOut(WindowQuadShadow);
+#endif
+
+    const QRect geometry = capturedGeometry(window);
+
+    // The texture may be smaller than the window, see setTextureScale().
     QMatrix4x4 projectionMatrix;
-    projectionMatrix.ortho(QRect(0, 0, it->texture->width(), it->texture->height()));
+    projectionMatrix.ortho(QRect(QPoint(0, 0), geometry.size()));
     data.setProjectionMatrix(projectionMatrix);
 
-    data.setXTranslation(-window->expandedGeometry().x());
-    data.setYTranslation(-window->expandedGeometry().y());
+    data.setXTranslation(-geometry.x());
+    data.setYTranslation(-geometry.y());
 
     effects->drawWindow(window, mask, infiniteRegion(), data);
 
     GLRenderTarget::popRenderTarget();
 
+    YAML_TRACE1(offscreen_render_end, window);
+
     it->isDirty = false;
 
     return it->texture;
 }
 
+/*!
+    Keeps a low resolution snapshot of the given window, which is used to
+    start the next animation of the window without rendering it first.
+*/
+void OffscreenRenderer::storeSnapshot(EffectWindow *window)
+{
+    auto it = m_renderResources.find(window);
+    if (it == m_renderResources.end())
+        return;
+
+    Snapshot snapshot;
+    snapshot.windowSize = capturedGeometry(window).size();
+
+    if (!it->texture) {
+        snapshot.texture = it->snapshot;
+        it->snapshot = nullptr;
+    } else {
+        snapshot.texture = createSnapshot(*it);
+    }
+
+    if (snapshot.texture)
+        insertSnapshot(window, snapshot);
+}
+
+/*!
+    Marks the end of the current frame. Windows whose snapshot has been shown
+    in this frame are rendered in full resolution from the next frame on.
+*/
+void OffscreenRenderer::endFrame()
+{
+    for (RenderResources &resources : m_renderResources) {
+        if (resources.isSnapshotShown)
+            resources.isSnapshotPresented = true;
+    }
+}
+
+/*!
+    Returns the part of the offscreen texture of the given window that is
+    known to be opaque, in normalized texture coordinates. An empty rect is
+    returned if no part of the window can be assumed to be opaque.
+
+    The rect isn't inset, keeping filtered samples away from translucent
+    texels depends on the size of the texture and how it's sampled.
+*/
+QRectF OffscreenRenderer::opaqueRect(EffectWindow *window) const
+{
+    if (window->hasAlpha() || window->opacity() < 1.0)
+        return QRectF();
+
+    QRect opaqueGeometry = window->geometry();
+    if (window->hasDecoration() && window->decorationHasAlpha())
+        opaqueGeometry = window->decorationInnerRect().translated(window->pos());
+
+    if (opaqueGeometry.isEmpty())
+        return QRectF();
+
+    const QRect geometry = capturedGeometry(window);
+    return QRectF(qreal(opaqueGeometry.x() - geometry.x()) / geometry.width(),
+                  qreal(opaqueGeometry.y() - geometry.y()) / geometry.height(),
+                  qreal(opaqueGeometry.width()) / geometry.width(),
+                  qreal(opaqueGeometry.height()) / geometry.height());
+}
+
+/*!
+    Returns whether offscreen textures are updated when windows are damaged.
+*/
+bool OffscreenRenderer::liveUpdatesEnabled() const
+{
+    return m_liveUpdatesEnabled;
+}
+
+/*!
+    Sets whether offscreen textures are updated when windows are damaged.
+    If live updates are disabled, windows keep their last rendered contents.
+*/
+void OffscreenRenderer::setLiveUpdatesEnabled(bool enabled)
+{
+    if (m_liveUpdatesEnabled == enabled)
+        return;
+
+    m_liveUpdatesEnabled = enabled;
+
+    // Windows might have been damaged in the meanwhile.
+    if (m_liveUpdatesEnabled) {
+        for (RenderResources &resources : m_renderResources)
+            resources.isDirty = true;
+    }
+}
+
+/*!
+    Returns the scale of offscreen textures relative to the size of windows.
+*/
+qreal OffscreenRenderer::textureScale() const
+{
+    return m_textureScale;
+}
+
+/*!
+    Sets the scale of offscreen textures relative to the size of windows. The
+    scale is applied to textures allocated after this call.
+*/
+void OffscreenRenderer::setTextureScale(qreal scale)
+{
+    m_textureScale = scale;
+}
+
+/*!
+    Returns whether window shadows are left out of offscreen textures.
+*/
+bool OffscreenRenderer::shadowsExcluded() const
+{
+    return m_shadowsExcluded;
+}
+
+/*!
+    Sets whether window shadows are left out of offscreen textures. Shadows
+    can make textures considerably larger. The setting is applied to textures
+    allocated after this call.
+*/
+void OffscreenRenderer::setShadowsExcluded(bool excluded)
+{
+    m_shadowsExcluded = excluded;
+}
+
+QRect OffscreenRenderer::capturedGeometry(EffectWindow *window) const
+{
+    return m_shadowsExcluded ? window->geometry() : window->expandedGeometry();
+}
+
 void OffscreenRenderer::slotWindowGeometryShapeChanged(EffectWindow *window, const QRect &old)
 {
     if (window->size() == old.size())
@@ -140,31 +348,56 @@ void OffscreenRenderer::slotWindowGeometryShapeChanged(EffectWindow *window, con
     else
         m_renderResources.erase(it);
     effects->doneOpenGLContextCurrent();
+
+    updateSubscriptions();
 }
 
 void OffscreenRenderer::slotWindowDeleted(EffectWindow *window)
 {
     effects->makeOpenGLContextCurrent();
     unregisterWindow(window);
+    freeSnapshot(window);
     effects->doneOpenGLContextCurrent();
 }
 
 void OffscreenRenderer::slotWindowDamaged(EffectWindow *window)
 {
+    if (!m_liveUpdatesEnabled)
+        return;
+
     auto it = m_renderResources.find(window);
     if (it != m_renderResources.end())
         it->isDirty = true;
 }
 
+/*!
+    Listens to damage and geometry changes only while there are registered
+    windows, so that idle windows cost nothing.
+*/
+void OffscreenRenderer::updateSubscriptions()
+{
+    if (m_renderResources.isEmpty()) {
+        disconnect(m_windowDamagedConnection);
+        disconnect(m_windowGeometryShapeChangedConnection);
+        m_windowDamagedConnection = QMetaObject::Connection();
+        m_windowGeometryShapeChangedConnection = QMetaObject::Connection();
+    } else if (!m_windowDamagedConnection) {
+        m_windowDamagedConnection = connect(effects, &EffectsHandler::windowDamaged,
+                                            this, &OffscreenRenderer::slotWindowDamaged);
+        m_windowGeometryShapeChangedConnection = connect(effects, &EffectsHandler::windowGeometryShapeChanged,
+                                                         this, &OffscreenRenderer::slotWindowGeometryShapeChanged);
+    }
+}
+
 OffscreenRenderer::RenderResources
 OffscreenRenderer::allocateRenderResources(EffectWindow *window)
 {
     effects->makeOpenGLContextCurrent();
-    const QRect geometry = window->expandedGeometry();
+    const QSize size = (QSizeF(capturedGeometry(window).size()) * m_textureScale).toSize().expandedTo(QSize(1, 1));
 
-    const int levels = std::floor(std::log2(std::min(geometry.width(), geometry.height()))) + 1;
+    const int levels = std::floor(std::log2(std::min(size.width(), size.height()))) + 1;
     QScopedPointer<GLTexture> texture;
-    texture.reset(new GLTexture(GL_RGBA8, geometry.width(), geometry.height(), levels));
+    texture.reset(new GLTexture(GL_RGBA8, size.width(), size.height(), levels));
     texture->setFilter(GL_LINEAR_MIPMAP_LINEAR);
     texture->setWrapMode(GL_CLAMP_TO_EDGE);
 
@@ -186,4 +419,81 @@ void OffscreenRenderer::freeRenderResources(RenderResources &resources)
 {
     delete resources.renderTarget;
     delete resources.texture;
+    delete resources.snapshot;
+}
+
+GLTexture *OffscreenRenderer::createSnapshot(const RenderResources &resources)
+{
+    if (!GLRenderTarget::blitSupported())
+        return nullptr;
+
+    const QSize size = resources.texture->size();
+    const qreal scale = qMin(1.0, qreal(maximumSnapshotSize) / qMax(size.width(), size.height()));
+    const QSize snapshotSize = (QSizeF(size) * scale).toSize().expandedTo(QSize(1, 1));
+
+    const int levels = std::floor(std::log2(std::min(snapshotSize.width(), snapshotSize.height()))) + 1;
+    QScopedPointer<GLTexture> snapshot;
+    snapshot.reset(new GLTexture(GL_RGBA8, snapshotSize.width(), snapshotSize.height(), levels));
+    snapshot->setFilter(GL_LINEAR_MIPMAP_LINEAR);
+    snapshot->setWrapMode(GL_CLAMP_TO_EDGE);
+
+    GLRenderTarget renderTarget(*snapshot);
+    if (!renderTarget.valid())
+        return nullptr;
+
+    GLint sourceFramebuffer = 0;
+    GLint targetFramebuffer = 0;
+
+    GLRenderTarget::pushRenderTarget(resources.renderTarget);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &sourceFramebuffer);
+    GLRenderTarget::pushRenderTarget(&renderTarget);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &targetFramebuffer);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFramebuffer);
+    glBlitFramebuffer(0, 0, size.width(), size.height(),
+                      0, 0, snapshotSize.width(), snapshotSize.height(),
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, targetFramebuffer);
+
+    GLRenderTarget::popRenderTarget();
+    GLRenderTarget::popRenderTarget();
+
+    return snapshot.take();
+}
+
+void OffscreenRenderer::insertSnapshot(EffectWindow *window, const Snapshot &snapshot)
+{
+    freeSnapshot(window);
+
+    m_snapshots.insert(window, snapshot);
+    m_snapshotOrder.append(window);
+    m_snapshotMemory += textureMemory(snapshot.texture);
+
+    // Evict the least recently minimized windows.
+    while (m_snapshotMemory > snapshotMemoryBudget && !m_snapshotOrder.isEmpty())
+        freeSnapshot(m_snapshotOrder.first());
+}
+
+OffscreenRenderer::Snapshot OffscreenRenderer::takeSnapshot(EffectWindow *window)
+{
+    const Snapshot snapshot = m_snapshots.take(window);
+    if (snapshot.texture) {
+        m_snapshotOrder.removeOne(window);
+        m_snapshotMemory -= textureMemory(snapshot.texture);
+    }
+    return snapshot;
+}
+
+void OffscreenRenderer::freeSnapshot(EffectWindow *window)
+{
+    delete takeSnapshot(window).texture;
+}
+
+void OffscreenRenderer::freeAllSnapshots()
+{
+    for (const Snapshot &snapshot : qAsConst(m_snapshots))
+        delete snapshot.texture;
+    m_snapshots.clear();
+    m_snapshotOrder.clear();
+    m_snapshotMemory = 0;
 }
@@ -23,8 +23,10 @@
 #include <kwinglutils.h>
 
 // Qt
+#include <QHash>
 #include <QMap>
 #include <QObject>
+#include <QVector>
 
 class OffscreenRenderer : public QObject
 {
@@ -38,8 +40,24 @@ public:
     void unregisterWindow(KWin::EffectWindow *window);
     void unregisterAllWindows();
 
+    KWin::GLTexture *prepare(KWin::EffectWindow *window);
     KWin::GLTexture *render(KWin::EffectWindow *window);
 
+    void storeSnapshot(KWin::EffectWindow *window);
+
+    void endFrame();
+
+    QRectF opaqueRect(KWin::EffectWindow *window) const;
+
+    bool liveUpdatesEnabled() const;
+    void setLiveUpdatesEnabled(bool enabled);
+
+    qreal textureScale() const;
+    void setTextureScale(qreal scale);
+
+    bool shadowsExcluded() const;
+    void setShadowsExcluded(bool excluded);
+
 private Q_SLOTS:
     void slotWindowGeometryShapeChanged(KWin::EffectWindow *window, const QRect& old);
     void slotWindowDeleted(KWin::EffectWindow *window);
@@ -50,18 +68,45 @@ private:
     {
         bool isValid() const
         {
-            return texture && renderTarget;
+            return (texture && renderTarget) || snapshot;
         }
 
         KWin::GLTexture *texture = nullptr;
         KWin::GLRenderTarget *renderTarget = nullptr;
+        KWin::GLTexture *snapshot = nullptr;
+        bool isSnapshotShown = false;
+        bool isSnapshotPresented = false;
         bool isDirty = false;
     };
 
+    struct Snapshot
+    {
+        KWin::GLTexture *texture = nullptr;
+
+        // The size of the captured geometry when the snapshot was taken.
+        QSize windowSize;
+    };
+
+    QRect capturedGeometry(KWin::EffectWindow *window) const;
+    void updateSubscriptions();
     RenderResources allocateRenderResources(KWin::EffectWindow *window);
     void freeRenderResources(RenderResources &resources);
 
+    KWin::GLTexture *createSnapshot(const RenderResources &resources);
+    void insertSnapshot(KWin::EffectWindow *window, const Snapshot &snapshot);
+    Snapshot takeSnapshot(KWin::EffectWindow *window);
+    void freeSnapshot(KWin::EffectWindow *window);
+    void freeAllSnapshots();
+
     QMap<KWin::EffectWindow *, RenderResources> m_renderResources;
+    QHash<KWin::EffectWindow *, Snapshot> m_snapshots;
+    QVector<KWin::EffectWindow *> m_snapshotOrder;
+    qint64 m_snapshotMemory = 0;
+    qreal m_textureScale = 1.0;
+    bool m_liveUpdatesEnabled = true;
+    bool m_shadowsExcluded = false;
+    QMetaObject::Connection m_windowDamagedConnection;
+    QMetaObject::Connection m_windowGeometryShapeChangedConnection;
 
     Q_DISABLE_COPY(OffscreenRenderer)
 };
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "QualityGovernor.h"
+
+// Qt
+#include <QtGlobal>
+
+// Intervals shorter than that are not considered as the refresh interval.
+static const std::chrono::milliseconds minimumExpectedInterval(6);
+
+// How many late frames in a row lower the quality by one step.
+static const int lateFrameThreshold = 3;
+
+// How many frames in a row have to be on time to raise the quality by one step.
+static const int onTimeFrameThreshold = 30;
+
+void QualityGovernor::update(std::chrono::milliseconds interval)
+{
+    if (interval <= std::chrono::milliseconds::zero()) {
+        return;
+    }
+
+    // The shortest interval between two frames is the refresh interval.
+    if (m_expectedInterval == std::chrono::milliseconds::zero() || interval < m_expectedInterval) {
+        m_expectedInterval = qMax(interval, minimumExpectedInterval);
+    }
+
+    const bool late = interval.count() * 2 > m_expectedInterval.count() * 3;
+
+    if (late) {
+        m_onTimeFrameCount = 0;
+        if (++m_lateFrameCount < lateFrameThreshold) {
+            return;
+        }
+        m_lateFrameCount = 0;
+        if (m_level != Level::ReducedTextures) {
+            m_level = static_cast<Level>(static_cast<int>(m_level) + 1);
+        }
+    } else {
+        m_lateFrameCount = 0;
+        if (++m_onTimeFrameCount < onTimeFrameThreshold) {
+            return;
+        }
+        m_onTimeFrameCount = 0;
+        if (m_level != Level::Full) {
+            m_level = static_cast<Level>(static_cast<int>(m_level) - 1);
+        }
+    }
+}
+
+void QualityGovernor::reset()
+{
+    m_expectedInterval = std::chrono::milliseconds::zero();
+    m_level = Level::Full;
+    m_lateFrameCount = 0;
+    m_onTimeFrameCount = 0;
+}
+
+QualityGovernor::Level QualityGovernor::level() const
+{
+    return m_level;
+}
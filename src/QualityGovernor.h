@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// std
+#include <chrono>
+
+/**
+ * Lowers the quality of the animation in steps when frames take longer than
+ * expected, and restores it once frames are on time again.
+ **/
+class QualityGovernor {
+public:
+    /**
+     * This enum type is used to specify the quality level. Each level
+     * includes the degradations of the previous levels.
+     **/
+    enum class Level {
+        // Everything is rendered at the configured quality.
+        Full,
+
+        // The resolution of the mesh is reduced.
+        ReducedMesh,
+
+        // The contents of animated windows are no longer updated.
+        FrozenContent,
+
+        // Windows are rendered into lower resolution textures.
+        ReducedTextures
+    };
+
+    /**
+     * Updates the governor with the interval between two presented frames.
+     **/
+    void update(std::chrono::milliseconds interval);
+
+    /**
+     * Restores the full quality and forgets the learned refresh interval, so
+     * it's learned again for the next animations, possibly on an output
+     * with a different refresh rate.
+     **/
+    void reset();
+
+    /**
+     * Returns the current quality level.
+     **/
+    Level level() const;
+
+private:
+    std::chrono::milliseconds m_expectedInterval = std::chrono::milliseconds::zero();
+    Level m_level = Level::Full;
+    int m_lateFrameCount = 0;
+    int m_onTimeFrameCount = 0;
+};
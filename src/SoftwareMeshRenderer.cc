@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "SoftwareMeshRenderer.h"
+
+// Qt
+#include <QtMath>
+
+// std
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct Vertex
+{
+    qreal x;
+    qreal y;
+    qreal u;
+    qreal v;
+};
+
+} // namespace
+
+static inline qreal edgeFunction(const Vertex &a, const Vertex &b, qreal x, qreal y)
+{
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+static inline bool isTopLeftEdge(const Vertex &a, const Vertex &b)
+{
+    return (a.y == b.y && b.x > a.x) || b.y < a.y;
+}
+
+static inline bool isInside(qreal w, bool topLeft)
+{
+    return w > 0 || (w == 0 && topLeft);
+}
+
+static inline QRgb interpolatePixel(QRgb x, uint a, QRgb y, uint b)
+{
+    // a + b must be 256.
+    uint t = (x & 0xff00ff) * a + (y & 0xff00ff) * b;
+    t >>= 8;
+    t &= 0xff00ff;
+
+    x = ((x >> 8) & 0xff00ff) * a + ((y >> 8) & 0xff00ff) * b;
+    x &= 0xff00ff00;
+
+    return x | t;
+}
+
+static inline QRgb multiplyPixel(QRgb x, uint a)
+{
+    uint t = (x & 0xff00ff) * a;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+
+    x = ((x >> 8) & 0xff00ff) * a;
+    x = x + ((x >> 8) & 0xff00ff) + 0x800080;
+    x &= 0xff00ff00;
+
+    return x | t;
+}
+
+static inline QRgb interpolateBilinear(QRgb topLeft, QRgb topRight,
+                                       QRgb bottomLeft, QRgb bottomRight, uint fx, uint fy)
+{
+#ifdef HAVE_SSE2
+    // All four texels are filtered at once with 16 bits per channel. The
+    // result is the same as with interpolatePixel().
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i top = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, topRight, topLeft), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, bottomRight, bottomLeft), zero);
+
+    const __m128i weightX = _mm_set_epi16(fx, fx, fx, fx, 256 - fx, 256 - fx, 256 - fx, 256 - fx);
+    top = _mm_mullo_epi16(top, weightX);
+    top = _mm_srli_epi16(_mm_add_epi16(top, _mm_srli_si128(top, 8)), 8);
+    bottom = _mm_mullo_epi16(bottom, weightX);
+    bottom = _mm_srli_epi16(_mm_add_epi16(bottom, _mm_srli_si128(bottom, 8)), 8);
+
+    const __m128i weightY = _mm_set_epi16(fy, fy, fy, fy, 256 - fy, 256 - fy, 256 - fy, 256 - fy);
+    __m128i result = _mm_mullo_epi16(_mm_unpacklo_epi64(top, bottom), weightY);
+    result = _mm_srli_epi16(_mm_add_epi16(result, _mm_srli_si128(result, 8)), 8);
+
+    return _mm_cvtsi128_si32(_mm_packus_epi16(result, zero));
+#else
+    const QRgb top = interpolatePixel(topLeft, 256 - fx, topRight, fx);
+    const QRgb bottom = interpolatePixel(bottomLeft, 256 - fx, bottomRight, fx);
+
+    return interpolatePixel(top, 256 - fy, bottom, fy);
+#endif
+}
+
+static inline QRgb blendSourceOver(QRgb source, QRgb destination)
+{
+    const uint alpha = qAlpha(source);
+    if (alpha == 255)
+        return source;
+    if (alpha == 0)
+        return destination;
+#ifdef HAVE_SSE2
+    // Same as multiplyPixel(), with all channels in one register.
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pixel = _mm_unpacklo_epi8(_mm_cvtsi32_si128(destination), zero);
+    pixel = _mm_mullo_epi16(pixel, _mm_set1_epi16(255 - alpha));
+    pixel = _mm_add_epi16(pixel, _mm_srli_epi16(pixel, 8));
+    pixel = _mm_srli_epi16(_mm_add_epi16(pixel, _mm_set1_epi16(0x80)), 8);
+    return source + _mm_cvtsi128_si32(_mm_packus_epi16(pixel, zero));
+#else
+    return source + multiplyPixel(destination, 255 - alpha);
+#endif
+}
+
+static inline QRgb sampleBilinear(const QImage &texture, qreal u, qreal v)
+{
+    const int width = texture.width();
+    const int height = texture.height();
+
+    // Texel centers are at half-integer coordinates.
+    const qreal s = u * width - 0.5;
+    const qreal t = v * height - 0.5;
+
+    const int left = qFloor(s);
+    const int top = qFloor(t);
+    const uint fx = qBound(0, qRound((s - left) * 256), 256);
+    const uint fy = qBound(0, qRound((t - top) * 256), 256);
+
+    const int x0 = qBound(0, left, width - 1);
+    const int x1 = qBound(0, left + 1, width - 1);
+    const int y0 = qBound(0, top, height - 1);
+    const int y1 = qBound(0, top + 1, height - 1);
+
+    const QRgb *row0 = reinterpret_cast<const QRgb *>(texture.constScanLine(y0));
+    const QRgb *row1 = reinterpret_cast<const QRgb *>(texture.constScanLine(y1));
+
+    return interpolateBilinear(row0[x0], row0[x1], row1[x0], row1[x1], fx, fy);
+}
+
+// Narrows [first, last] to the pixels of a scan line where the edge function,
+// which is w at the first pixel and changes by step per pixel, may be inside.
+// The span is conservative, the pixels in it still have to be tested.
+static inline void clipSpan(qreal w, qreal step, int *first, int *last)
+{
+    if (step > 0) {
+        const qreal bound = std::ceil(-w / step) - 1;
+        if (bound > *first)
+            *first = bound > *last ? *last + 1 : int(bound);
+    } else if (step < 0) {
+        const qreal bound = std::floor(w / -step) + 1;
+        if (bound < *last)
+            *last = bound < *first ? *first - 1 : int(bound);
+    } else if (w < 0) {
+        *last = *first - 1;
+    }
+}
+
+static void rasterizeTriangle(QImage *target, const QRect &clipRect, const QImage &texture,
+                              Vertex v0, Vertex v1, Vertex v2)
+{
+    qreal area = edgeFunction(v0, v1, v2.x, v2.y);
+    if (qFuzzyIsNull(area))
+        return;
+
+    // Make the winding consistent so that pixels inside have positive weights.
+    if (area < 0) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    const qreal left = std::min({ v0.x, v1.x, v2.x });
+    const qreal top = std::min({ v0.y, v1.y, v2.y });
+    const qreal right = std::max({ v0.x, v1.x, v2.x });
+    const qreal bottom = std::max({ v0.y, v1.y, v2.y });
+
+    const QRect bounds = QRect(QPoint(qFloor(left), qFloor(top)),
+                               QPoint(qCeil(right), qCeil(bottom))) & clipRect;
+    if (bounds.isEmpty())
+        return;
+
+    // Pixels on edges shared by two triangles are drawn only once.
+    const bool topLeft0 = isTopLeftEdge(v1, v2);
+    const bool topLeft1 = isTopLeftEdge(v2, v0);
+    const bool topLeft2 = isTopLeftEdge(v0, v1);
+
+    const qreal stepX0 = v1.y - v2.y;
+    const qreal stepX1 = v2.y - v0.y;
+    const qreal stepX2 = v0.y - v1.y;
+
+    const qreal invArea = 1.0 / area;
+
+    for (int y = bounds.top(); y <= bounds.bottom(); ++y) {
+        const qreal sampleX = bounds.left() + 0.5;
+        const qreal sampleY = y + 0.5;
+
+        qreal w0 = edgeFunction(v1, v2, sampleX, sampleY);
+        qreal w1 = edgeFunction(v2, v0, sampleX, sampleY);
+        qreal w2 = edgeFunction(v0, v1, sampleX, sampleY);
+
+        // Skip the parts of the bounding box that are outside the triangle,
+        // they make up about half of it.
+        int first = 0;
+        int last = bounds.width() - 1;
+        clipSpan(w0, stepX0, &first, &last);
+        clipSpan(w1, stepX1, &first, &last);
+        clipSpan(w2, stepX2, &first, &last);
+        if (first > last)
+            continue;
+
+        w0 += first * stepX0;
+        w1 += first * stepX1;
+        w2 += first * stepX2;
+
+        QRgb *scanLine = reinterpret_cast<QRgb *>(target->scanLine(y));
+
+        for (int x = bounds.left() + first; x <= bounds.left() + last; ++x) {
+            if (isInside(w0, topLeft0) && isInside(w1, topLeft1) && isInside(w2, topLeft2)) {
+                const qreal u = (w0 * v0.u + w1 * v1.u + w2 * v2.u) * invArea;
+                const qreal v = (w0 * v0.v + w1 * v1.v + w2 * v2.v) * invArea;
+                scanLine[x] = blendSourceOver(sampleBilinear(texture, u, v), scanLine[x]);
+            }
+
+            w0 += stepX0;
+            w1 += stepX1;
+            w2 += stepX2;
+        }
+    }
+}
+
+/*!
+    Draws the given mesh textured with \p texture into the \p target image.
+
+    The mesh is positioned at \p position. Both \p targetOrigin and
+    \p clipRegion are in the same coordinate space as \p position, the clip
+    region is applied rect by rect like a scissor test. The target image must
+    be in the premultiplied ARGB32 format, the texture is converted to it if
+    needed. The result is blended over the contents of the target image.
+*/
+void SoftwareMeshRenderer::render(QImage *target, const QPoint &targetOrigin,
+                                  const QVector<WindowQuad> &quads, const QPointF &position,
+                                  const QImage &texture, const QRegion &clipRegion) const
+{
+    Q_ASSERT(target->format() == QImage::Format_ARGB32_Premultiplied);
+
+    if (texture.isNull() || quads.isEmpty())
+        return;
+
+    const QImage source = texture.format() == QImage::Format_ARGB32_Premultiplied
+        ? texture
+        : texture.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    const QRect targetRect(targetOrigin, target->size());
+    const QPointF offset = position - targetOrigin;
+
+    for (const QRect &rect : clipRegion) {
+        const QRect clipRect = (rect & targetRect).translated(-targetOrigin);
+        if (clipRect.isEmpty())
+            continue;
+
+        for (const WindowQuad &quad : quads) {
+            Vertex vertices[4];
+            for (int i = 0; i < 4; ++i) {
+                vertices[i].x = quad[i].x() + offset.x();
+                vertices[i].y = quad[i].y() + offset.y();
+                vertices[i].u = quad[i].u();
+                vertices[i].v = quad[i].v();
+            }
+
+            rasterizeTriangle(target, clipRect, source, vertices[0], vertices[1], vertices[2]);
+            rasterizeTriangle(target, clipRect, source, vertices[0], vertices[2], vertices[3]);
+        }
+    }
+}
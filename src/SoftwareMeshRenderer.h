@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Own
+#include "WindowQuad.h"
+
+// Qt
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+class SoftwareMeshRenderer
+{
+public:
+    void render(QImage *target, const QPoint &targetOrigin,
+                const QVector<WindowQuad> &quads, const QPointF &position,
+                const QImage &texture, const QRegion &clipRegion) const;
+};
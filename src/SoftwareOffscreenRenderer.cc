@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "SoftwareOffscreenRenderer.h"
+#include "Tracepoints.h"
+
+// Qt
+#include <QPainter>
+
+using namespace KWin;
+
+// Recovers the premultiplied pixels of a window from two renderings of it,
+// one on black and one on white. This is needed if the device of the scene
+// painter has no alpha channel. On white, every channel is raised by
+// 255 * (1 - alpha), so the difference between both renderings is the
+// transparency.
+static void combineRenderings(const QImage &onBlack, const QImage &onWhite,
+                              QImage *image, const QPoint &position)
+{
+    for (int y = 0; y < onBlack.height(); ++y) {
+        const QRgb *black = reinterpret_cast<const QRgb *>(onBlack.constScanLine(y));
+        const QRgb *white = reinterpret_cast<const QRgb *>(onWhite.constScanLine(y));
+        QRgb *out = reinterpret_cast<QRgb *>(image->scanLine(position.y() + y)) + position.x();
+
+        for (int x = 0; x < onBlack.width(); ++x) {
+            const int alpha = 255 - qBound(0, qGreen(white[x]) - qGreen(black[x]), 255);
+            out[x] = qRgba(qMin(qRed(black[x]), alpha),
+                           qMin(qGreen(black[x]), alpha),
+                           qMin(qBlue(black[x]), alpha),
+                           alpha);
+        }
+    }
+}
+
+/*!
+    Constructs a SoftwareOffscreenRenderer object with the given \p parent.
+*/
+SoftwareOffscreenRenderer::SoftwareOffscreenRenderer(QObject *parent)
+    : QObject(parent)
+{
+    connect(effects, &EffectsHandler::windowDeleted,
+            this, &SoftwareOffscreenRenderer::slotWindowDeleted);
+}
+
+/*!
+    Destructs the SoftwareOffscreenRenderer object.
+*/
+SoftwareOffscreenRenderer::~SoftwareOffscreenRenderer()
+{
+    unregisterAllWindows();
+}
+
+/*!
+    Allocates the image the given window is rendered into.
+*/
+void SoftwareOffscreenRenderer::registerWindow(EffectWindow *window)
+{
+    if (m_renderResources.contains(window))
+        return;
+
+    RenderResources resources = allocateRenderResources(window);
+    if (!resources.image.isNull())
+        m_renderResources[window] = resources;
+
+    updateSubscriptions();
+}
+
+/*!
+    Frees the image of the given window.
+*/
+void SoftwareOffscreenRenderer::unregisterWindow(EffectWindow *window)
+{
+    if (!m_renderResources.remove(window))
+        return;
+
+    updateSubscriptions();
+}
+
+/*!
+    Frees the images of all windows.
+*/
+void SoftwareOffscreenRenderer::unregisterAllWindows()
+{
+    m_renderResources.clear();
+    updateSubscriptions();
+}
+
+/*!
+    Returns the offscreen image of the given window without updating it.
+*/
+const QImage *SoftwareOffscreenRenderer::image(EffectWindow *window) const
+{
+    auto it = m_renderResources.constFind(window);
+    if (it == m_renderResources.constEnd())
+        return nullptr;
+
+    return &it->image;
+}
+
+/*!
+    Renders the given window into its offscreen image.
+
+    The window can only be painted by the scene painter, which can't be
+    redirected while it's active. Instead, the window is painted onto the
+    device of the scene painter, one tile at a time, and copied into the
+    offscreen image. What the scene has painted on the tile is put back
+    afterwards. The scene painter is never ended, its state is only changed
+    between save() and restore(), so this can be called at any time while
+    the scene painter is active.
+*/
+const QImage *SoftwareOffscreenRenderer::render(EffectWindow *window)
+{
+    auto it = m_renderResources.find(window);
+    if (it == m_renderResources.end())
+        return nullptr;
+
+    if (!it->isDirty)
+        return &it->image;
+
+    QPainter *painter = effects->scenePainter();
+    if (!painter || !painter->isActive() || painter->device()->devType() != QInternal::Image)
+        return &it->image;
+
+    YAML_TRACE3(offscreen_render_begin, window, it->image.width(), it->image.height());
+
+    QImage *device = static_cast<QImage *>(painter->device());
+    const QRect geometry = capturedGeometry(window);
+    const QSize tileSize = device->size().boundedTo(it->image.size());
+
+    // The image may be smaller than the window, see setTextureScale().
+    const QTransform scale = QTransform::fromScale(qreal(it->image.width()) / geometry.width(),
+                                                   qreal(it->image.height()) / geometry.height());
+
+    painter->save();
+    painter->setViewTransformEnabled(false);
+    painter->setWorldMatrixEnabled(true);
+    painter->setOpacity(1.0);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, !scale.isIdentity());
+
+    for (int y = 0; y < it->image.height(); y += tileSize.height()) {
+        for (int x = 0; x < it->image.width(); x += tileSize.width()) {
+            const QRect tile = QRect(QPoint(x, y), tileSize) & it->image.rect();
+            const QTransform transform = scale * QTransform::fromTranslate(-tile.x(), -tile.y());
+            renderTile(window, geometry.topLeft(), transform, tile, painter, device, &it->image);
+        }
+    }
+
+    painter->restore();
+
+    YAML_TRACE1(offscreen_render_end, window);
+
+    it->isDirty = false;
+
+    return &it->image;
+}
+
+/*!
+    Returns whether offscreen images are updated when windows are damaged.
+*/
+bool SoftwareOffscreenRenderer::liveUpdatesEnabled() const
+{
+    return m_liveUpdatesEnabled;
+}
+
+/*!
+    Sets whether offscreen images are updated when windows are damaged.
+    If live updates are disabled, windows keep their last rendered contents.
+*/
+void SoftwareOffscreenRenderer::setLiveUpdatesEnabled(bool enabled)
+{
+    if (m_liveUpdatesEnabled == enabled)
+        return;
+
+    m_liveUpdatesEnabled = enabled;
+
+    // Windows might have been damaged in the meanwhile.
+    if (m_liveUpdatesEnabled) {
+        for (RenderResources &resources : m_renderResources)
+            resources.isDirty = true;
+    }
+}
+
+/*!
+    Returns the scale of offscreen images relative to the size of windows.
+*/
+qreal SoftwareOffscreenRenderer::textureScale() const
+{
+    return m_textureScale;
+}
+
+/*!
+    Sets the scale of offscreen images relative to the size of windows. The
+    scale is applied to images allocated after this call.
+*/
+void SoftwareOffscreenRenderer::setTextureScale(qreal scale)
+{
+    m_textureScale = scale;
+}
+
+/*!
+    Returns whether window shadows are left out of offscreen images.
+*/
+bool SoftwareOffscreenRenderer::shadowsExcluded() const
+{
+    return m_shadowsExcluded;
+}
+
+/*!
+    Sets whether window shadows are left out of offscreen images. The
+    setting is applied to images allocated after this call.
+*/
+void SoftwareOffscreenRenderer::setShadowsExcluded(bool excluded)
+{
+    m_shadowsExcluded = excluded;
+}
+
+// Paints the given tile of the offscreen image onto the top left corner of
+// the device and copies it into the offscreen image. The transform maps the
+// window, with its captured geometry at origin, onto the device.
+void SoftwareOffscreenRenderer::renderTile(EffectWindow *window, const QPoint &origin,
+                                           const QTransform &transform, const QRect &tile,
+                                           QPainter *painter, QImage *device, QImage *image)
+{
+    const QRect deviceRect(QPoint(0, 0), tile.size());
+    const QImage background = device->copy(deviceRect);
+
+    painter->resetTransform();
+    painter->setClipRect(deviceRect);
+
+    if (device->hasAlphaChannel()) {
+        paintTile(window, origin, transform, deviceRect, painter, Qt::transparent);
+
+        QPainter imagePainter(image);
+        imagePainter.setCompositionMode(QPainter::CompositionMode_Source);
+        imagePainter.drawImage(tile.topLeft(), *device, deviceRect);
+    } else {
+        paintTile(window, origin, transform, deviceRect, painter, Qt::black);
+        const QImage onBlack = device->copy(deviceRect).convertToFormat(QImage::Format_RGB32);
+        paintTile(window, origin, transform, deviceRect, painter, Qt::white);
+        const QImage onWhite = device->copy(deviceRect).convertToFormat(QImage::Format_RGB32);
+        combineRenderings(onBlack, onWhite, image, tile.topLeft());
+    }
+
+    painter->setCompositionMode(QPainter::CompositionMode_Source);
+    painter->drawImage(deviceRect.topLeft(), background);
+    painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+}
+
+void SoftwareOffscreenRenderer::paintTile(EffectWindow *window, const QPoint &origin,
+                                          const QTransform &transform, const QRect &deviceRect,
+                                          QPainter *painter, const QColor &color)
+{
+    painter->setCompositionMode(QPainter::CompositionMode_Source);
+    painter->fillRect(deviceRect, color);
+    painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+    const int mask = Effect::PAINT_WINDOW_TRANSFORMED | Effect::PAINT_WINDOW_TRANSLUCENT;
+
+    WindowPaintData data(window);
+
+#if KWIN_EFFECT_API_VERSION < KWIN_EFFECT_API_MAKE_VERSION(0, 233)
+    // Don't paint the shadow just to have it cut off by the tile.
+    if (m_shadowsExcluded)
+        data.quads = data.quads.filterOut(WindowQuadShadow);
+#endif
+
+    data.setXTranslation(-origin.x());
+    data.setYTranslation(-origin.y());
+
+    painter->setTransform(transform);
+    effects->drawWindow(window, mask, infiniteRegion(), data);
+    painter->resetTransform();
+}
+
+QRect SoftwareOffscreenRenderer::capturedGeometry(EffectWindow *window) const
+{
+    return m_shadowsExcluded ? window->geometry() : window->expandedGeometry();
+}
+
+void SoftwareOffscreenRenderer::slotWindowGeometryShapeChanged(EffectWindow *window, const QRect &old)
+{
+    if (window->size() == old.size())
+        return;
+
+    auto it = m_renderResources.find(window);
+    if (it == m_renderResources.end())
+        return;
+
+    RenderResources resources = allocateRenderResources(window);
+    if (!resources.image.isNull())
+        *it = resources;
+    else
+        m_renderResources.erase(it);
+
+    updateSubscriptions();
+}
+
+void SoftwareOffscreenRenderer::slotWindowDeleted(EffectWindow *window)
+{
+    unregisterWindow(window);
+}
+
+void SoftwareOffscreenRenderer::slotWindowDamaged(EffectWindow *window)
+{
+    if (!m_liveUpdatesEnabled)
+        return;
+
+    auto it = m_renderResources.find(window);
+    if (it != m_renderResources.end())
+        it->isDirty = true;
+}
+
+/*!
+    Listens to damage and geometry changes only while there are registered
+    windows, so that idle windows cost nothing.
+*/
+void SoftwareOffscreenRenderer::updateSubscriptions()
+{
+    if (m_renderResources.isEmpty()) {
+        disconnect(m_windowDamagedConnection);
+        disconnect(m_windowGeometryShapeChangedConnection);
+        m_windowDamagedConnection = QMetaObject::Connection();
+        m_windowGeometryShapeChangedConnection = QMetaObject::Connection();
+    } else if (!m_windowDamagedConnection) {
+        m_windowDamagedConnection = connect(effects, &EffectsHandler::windowDamaged,
+                                            this, &SoftwareOffscreenRenderer::slotWindowDamaged);
+        m_windowGeometryShapeChangedConnection = connect(effects, &EffectsHandler::windowGeometryShapeChanged,
+                                                         this, &SoftwareOffscreenRenderer::slotWindowGeometryShapeChanged);
+    }
+}
+
+SoftwareOffscreenRenderer::RenderResources
+SoftwareOffscreenRenderer::allocateRenderResources(EffectWindow *window)
+{
+    const QSize size = (QSizeF(capturedGeometry(window).size()) * m_textureScale).toSize().expandedTo(QSize(1, 1));
+
+    RenderResources resources;
+    resources.image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    resources.isDirty = true;
+
+    // The image may be shown before the window is rendered into it.
+    resources.image.fill(Qt::transparent);
+
+    return resources;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// kwineffects
+#include <kwineffects.h>
+
+// Qt
+#include <QImage>
+#include <QMap>
+#include <QObject>
+#include <QTransform>
+
+class QPainter;
+
+class SoftwareOffscreenRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SoftwareOffscreenRenderer(QObject *parent = nullptr);
+    ~SoftwareOffscreenRenderer() override;
+
+    void registerWindow(KWin::EffectWindow *window);
+    void unregisterWindow(KWin::EffectWindow *window);
+    void unregisterAllWindows();
+
+    const QImage *image(KWin::EffectWindow *window) const;
+    const QImage *render(KWin::EffectWindow *window);
+
+    bool liveUpdatesEnabled() const;
+    void setLiveUpdatesEnabled(bool enabled);
+
+    qreal textureScale() const;
+    void setTextureScale(qreal scale);
+
+    bool shadowsExcluded() const;
+    void setShadowsExcluded(bool excluded);
+
+private Q_SLOTS:
+    void slotWindowGeometryShapeChanged(KWin::EffectWindow *window, const QRect &old);
+    void slotWindowDeleted(KWin::EffectWindow *window);
+    void slotWindowDamaged(KWin::EffectWindow *window);
+
+private:
+    struct RenderResources
+    {
+        QImage image;
+        bool isDirty = false;
+    };
+
+    void renderTile(KWin::EffectWindow *window, const QPoint &origin,
+                    const QTransform &transform, const QRect &tile,
+                    QPainter *painter, QImage *device, QImage *image);
+    void paintTile(KWin::EffectWindow *window, const QPoint &origin,
+                   const QTransform &transform, const QRect &deviceRect,
+                   QPainter *painter, const QColor &color);
+    QRect capturedGeometry(KWin::EffectWindow *window) const;
+    void updateSubscriptions();
+    RenderResources allocateRenderResources(KWin::EffectWindow *window);
+
+    QMap<KWin::EffectWindow *, RenderResources> m_renderResources;
+    qreal m_textureScale = 1.0;
+    bool m_liveUpdatesEnabled = true;
+    bool m_shadowsExcluded = false;
+    QMetaObject::Connection m_windowDamagedConnection;
+    QMetaObject::Connection m_windowGeometryShapeChangedConnection;
+
+    Q_DISABLE_COPY(SoftwareOffscreenRenderer)
+};
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Static (USDT) tracepoints for perf, bpftrace and SystemTap. The tracepoints
+ * are compiled in only if the effect is built with -DYAML_ENABLE_TRACEPOINTS=ON.
+ * Each tracepoint is a single nop instruction until a probe is attached.
+ *
+ * All tracepoints live in the "yaml" provider, for example
+ *
+ *   bpftrace -e 'usdt:/path/to/kwin4_effect_yetanothermagiclamp.so:yaml:mesh_deform_end { ... }'
+ *
+ * Progress values are passed in per mille because not all toolchains can
+ * encode floating point probe arguments.
+ **/
+
+#if defined(YAML_TRACEPOINTS)
+
+// std
+#include <sys/sdt.h>
+
+#define YAML_TRACE1(name, a1) DTRACE_PROBE1(yaml, name, a1)
+#define YAML_TRACE2(name, a1, a2) DTRACE_PROBE2(yaml, name, a1, a2)
+#define YAML_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(yaml, name, a1, a2, a3)
+#define YAML_TRACE4(name, a1, a2, a3, a4) DTRACE_PROBE4(yaml, name, a1, a2, a3, a4)
+
+#else
+
+#define YAML_TRACE1(name, a1) \
+    do {                      \
+    } while (false)
+#define YAML_TRACE2(name, a1, a2) \
+    do {                          \
+    } while (false)
+#define YAML_TRACE3(name, a1, a2, a3) \
+    do {                              \
+    } while (false)
+#define YAML_TRACE4(name, a1, a2, a3, a4) \
+    do {                                  \
+    } while (false)
+
+#endif
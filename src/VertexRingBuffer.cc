@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "VertexRingBuffer.h"
+
+// kwineffects
+#include <kwinglplatform.h>
+
+// std
+#include <algorithm>
+#include <cstddef>
+
+// The smallest amount of memory reserved for a frame.
+static const size_t minimumSegmentSize = 64 * 1024;
+
+// How long to wait for the GPU to release a segment, in nanoseconds.
+static const GLuint64 fenceTimeout = 1000 * 1000 * 1000;
+
+static size_t nextPowerOfTwo(size_t size)
+{
+    size_t result = minimumSegmentSize;
+    while (result < size)
+        result *= 2;
+    return result;
+}
+
+/*!
+    Constructs a VertexRingBuffer object. The OpenGL context must be current.
+*/
+VertexRingBuffer::VertexRingBuffer()
+{
+    // Each frame writes its vertices into the next segment of the buffer,
+    // and a fence is inserted once the frame has been submitted. A segment
+    // is only written again after its fence has been signaled, so mapping
+    // never stalls on pending draws and the buffer never has to be orphaned.
+    // Without fences, the buffer is orphaned on every upload instead.
+    const bool isGLES = KWin::GLPlatform::instance()->isGLES();
+    const bool haveSync = isGLES
+        ? KWin::hasGLVersion(3, 0)
+        : KWin::hasGLVersion(3, 2) || KWin::hasGLExtension(QByteArrayLiteral("GL_ARB_sync"));
+    const bool haveMapBufferRange = isGLES
+        ? KWin::hasGLVersion(3, 0) || KWin::hasGLExtension(QByteArrayLiteral("GL_EXT_map_buffer_range"))
+        : KWin::hasGLVersion(3, 0) || KWin::hasGLExtension(QByteArrayLiteral("GL_ARB_map_buffer_range"));
+    const bool haveBufferStorage = !isGLES
+        && (KWin::hasGLVersion(4, 4) || KWin::hasGLExtension(QByteArrayLiteral("GL_ARB_buffer_storage")));
+
+    if (haveSync && haveBufferStorage)
+        m_mode = Mode::Persistent;
+    else if (haveSync && haveMapBufferRange)
+        m_mode = Mode::MapRange;
+    else
+        m_mode = Mode::Orphan;
+}
+
+/*!
+    Destructs the VertexRingBuffer object. The OpenGL context must be current.
+*/
+VertexRingBuffer::~VertexRingBuffer()
+{
+    release();
+}
+
+/*!
+    Returns memory for \p vertexCount vertices in the segment of the current
+    frame. The memory must be released with unmap() before drawing.
+*/
+KWin::GLVertex2D *VertexRingBuffer::map(int vertexCount)
+{
+    const size_t size = vertexCount * sizeof(KWin::GLVertex2D);
+
+    if (m_mode == Mode::Orphan) {
+        m_staging.resize(vertexCount);
+        m_mappedOffset = 0;
+        m_mappedSize = size;
+        return m_staging.data();
+    }
+
+    // Grow to the largest frame seen so far. The old buffer is only deleted
+    // after the draws of the previous uploads have been issued.
+    if (!m_buffer || m_offset + size > m_segmentSize)
+        allocate(m_offset + size);
+
+    // If the GPU may still be reading the segment, write into a new buffer
+    // instead. The old one is deleted by the driver once its draws are done.
+    if (!m_offset && !waitForSegment(m_segment))
+        allocate(std::max(size, m_segmentSize));
+
+    m_mappedOffset = m_segment * m_segmentSize + m_offset;
+    m_mappedSize = size;
+    m_offset += size;
+
+    if (m_mode == Mode::Persistent)
+        return reinterpret_cast<KWin::GLVertex2D *>(static_cast<char *>(m_persistentMap) + m_mappedOffset);
+
+    // The fence of the segment has been signaled, so nothing reads this range.
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    void *map = glMapBufferRange(GL_ARRAY_BUFFER, m_mappedOffset, m_mappedSize,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return static_cast<KWin::GLVertex2D *>(map);
+}
+
+/*!
+    Releases the memory returned by map().
+*/
+void VertexRingBuffer::unmap()
+{
+    switch (m_mode) {
+    case Mode::Persistent:
+        // The mapping is coherent, there is nothing to flush.
+        break;
+
+    case Mode::MapRange:
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        break;
+
+    case Mode::Orphan:
+        if (!m_buffer)
+            glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glBufferData(GL_ARRAY_BUFFER, m_mappedSize, m_staging.constData(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        break;
+    }
+}
+
+/*!
+    Returns the index of the first vertex written by the last call to map().
+*/
+int VertexRingBuffer::baseVertex() const
+{
+    return m_mappedOffset / sizeof(KWin::GLVertex2D);
+}
+
+/*!
+    Binds the buffer and sets up the vertex attributes of KWin's shaders.
+*/
+void VertexRingBuffer::bind() const
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    glVertexAttribPointer(KWin::VA_Position, 2, GL_FLOAT, GL_FALSE, sizeof(KWin::GLVertex2D),
+                          reinterpret_cast<const GLvoid *>(offsetof(KWin::GLVertex2D, position)));
+    glEnableVertexAttribArray(KWin::VA_Position);
+
+    glVertexAttribPointer(KWin::VA_TexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(KWin::GLVertex2D),
+                          reinterpret_cast<const GLvoid *>(offsetof(KWin::GLVertex2D, texcoord)));
+    glEnableVertexAttribArray(KWin::VA_TexCoord);
+}
+
+/*!
+    Reverts bind().
+*/
+void VertexRingBuffer::unbind() const
+{
+    glDisableVertexAttribArray(KWin::VA_Position);
+    glDisableVertexAttribArray(KWin::VA_TexCoord);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*!
+    Fences the segment of the current frame and moves on to the next one.
+    This must be called after all draws of the frame have been issued.
+*/
+void VertexRingBuffer::endFrame()
+{
+    if (m_mode == Mode::Orphan || !m_offset)
+        return;
+
+    m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_segment = (m_segment + 1) % segmentCount;
+    m_offset = 0;
+}
+
+void VertexRingBuffer::allocate(size_t frameSize)
+{
+    release();
+
+    m_segmentSize = nextPowerOfTwo(frameSize);
+    m_segment = 0;
+    m_offset = 0;
+
+    const size_t bufferSize = segmentCount * m_segmentSize;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    if (m_mode == Mode::Persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, bufferSize, nullptr, flags);
+        m_persistentMap = glMapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize, flags);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void VertexRingBuffer::release()
+{
+    for (GLsync &fence : m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    if (!m_buffer)
+        return;
+
+    if (m_persistentMap) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_persistentMap = nullptr;
+    }
+
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
+
+// Returns whether the GPU is done with the segment.
+bool VertexRingBuffer::waitForSegment(int segment)
+{
+    GLsync &fence = m_fences[segment];
+    if (!fence)
+        return true;
+
+    // With three segments, the fence has almost always been signaled.
+    const GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, fenceTimeout);
+    glDeleteSync(fence);
+    fence = nullptr;
+
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// kwineffects
+#include <kwinglutils.h>
+
+// Qt
+#include <QVector>
+
+class VertexRingBuffer
+{
+public:
+    VertexRingBuffer();
+    ~VertexRingBuffer();
+
+    KWin::GLVertex2D *map(int vertexCount);
+    void unmap();
+
+    int baseVertex() const;
+
+    void bind() const;
+    void unbind() const;
+
+    void endFrame();
+
+private:
+    enum class Mode {
+        Persistent,
+        MapRange,
+        Orphan
+    };
+
+    void allocate(size_t frameSize);
+    void release();
+    bool waitForSegment(int segment);
+
+    static const int segmentCount = 3;
+
+    Mode m_mode;
+    GLuint m_buffer = 0;
+    GLvoid *m_persistentMap = nullptr;
+    GLsync m_fences[segmentCount] = {};
+    size_t m_segmentSize = 0;
+    int m_segment = 0;
+    size_t m_offset = 0;
+    size_t m_mappedOffset = 0;
+    size_t m_mappedSize = 0;
+    QVector<KWin::GLVertex2D> m_staging;
+
+    Q_DISABLE_COPY(VertexRingBuffer)
+};
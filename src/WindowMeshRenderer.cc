@@ -17,25 +17,18 @@
 
 // Own
 #include "WindowMeshRenderer.h"
+#include "Tracepoints.h"
 
 // kwineffects
+#include <kwinglplatform.h>
 #include <kwinglutils.h>
 
-#if defined(__GNUC__)
-#define KWIN_ALIGN(n) __attribute((aligned(n)))
-#if defined(__SSE2__)
-#define HAVE_SSE2
-#endif
-#elif defined(__INTEL_COMPILER)
-#define KWIN_ALIGN(n) __declspec(align(n))
-#define HAVE_SSE2
-#else
-#define KWIN_ALIGN(n)
-#endif
-
-#ifdef HAVE_SSE2
-#include <emmintrin.h>
-#endif
+// std
+#include <algorithm>
+
+// The opaque part of meshes is drawn with the level of detail clamped to
+// this level, which bounds how far from the opaque rect samples can reach.
+static const int opaqueMaximumLevel = 4;
 
 /*!
     Constructs a WindowMeshRenderer object with the given \p parent.
@@ -45,65 +38,87 @@ WindowMeshRenderer::WindowMeshRenderer(QObject *parent)
 {
 }
 
-QVector<WindowQuad> WindowMeshRenderer::makeGrid(const KWin::EffectWindow *window, int gridResolution)
+/*!
+    Destructs the WindowMeshRenderer object.
+*/
+WindowMeshRenderer::~WindowMeshRenderer()
 {
-    QVector<WindowQuad> quads;
-    quads.reserve(gridResolution * gridResolution);
-
-    const QRectF geometry = window->geometry();
-    const QRectF expandedGeometry = window->expandedGeometry();
-
-    const qreal initialX = expandedGeometry.x() - geometry.x();
-    const qreal initialY = expandedGeometry.y() - geometry.y();
-    const qreal initialU = 0.0;
-    const qreal initialV = 0.0;
-
-    const qreal dx = static_cast<qreal>(window->expandedGeometry().width()) / gridResolution;
-    const qreal dy = static_cast<qreal>(window->expandedGeometry().height()) / gridResolution;
-    const qreal du = 1.0 / gridResolution;
-    const qreal dv = 1.0 / gridResolution;
-
-    qreal y = initialY;
-    qreal v = initialV;
-    for (int i = 0; i < gridResolution; ++i) {
-        qreal x = initialX;
-        qreal u = initialU;
-        for (int j = 0; j < gridResolution; ++j) {
-            WindowQuad quad;
-
-            quad[0].setX(x);
-            quad[0].setY(y);
-            quad[0].setU(u);
-            quad[0].setV(v);
-
-            quad[1].setX(x + dx);
-            quad[1].setY(y);
-            quad[1].setU(u + du);
-            quad[1].setV(v);
-
-            quad[2].setX(x + dx);
-            quad[2].setY(y + dy);
-            quad[2].setU(u + du);
-            quad[2].setV(v + dv);
-
-            quad[3].setX(x);
-            quad[3].setY(y + dy);
-            quad[3].setU(u);
-            quad[3].setV(v + dv);
-
-            quads.append(quad);
-            x += dx;
-            u += du;
-        }
-        y += dy;
-        v += dv;
+    if (m_vertexBuffer) {
+        KWin::effects->makeOpenGLContextCurrent();
+        delete m_vertexBuffer;
     }
+}
+
+static inline bool isSameVertex(const WindowVertex &a, const WindowVertex &b)
+{
+    return a.x() == b.x() && a.y() == b.y() && a.u() == b.u() && a.v() == b.v();
+}
 
-    return quads;
+// Returns whether the given quad shares its left edge with the right edge of
+// the previous quad, i.e. whether both quads can be put in one triangle strip.
+static inline bool continuesStrip(const WindowQuad &previous, const WindowQuad &quad)
+{
+    return isSameVertex(previous[1], quad[0]) && isSameVertex(previous[2], quad[3]);
 }
 
-// Copied from libkwineffects.
-static void uploadQuads(GLenum primitiveType, const QVector<WindowQuad> &quads,
+// Returns the number of vertices needed to draw the given quads as a single
+// triangle strip, with degenerate triangles joining disconnected runs.
+static int stripVertexCount(const WindowQuad *quads, int quadCount)
+{
+    if (!quadCount)
+        return 0;
+
+    int count = 4;
+    for (int i = 1; i < quadCount; i++) {
+        if (continuesStrip(quads[i - 1], quads[i]))
+            count += 2;
+        else
+            count += 6;
+    }
+
+    return count;
+}
+
+// Returns whether the texture coordinates of the given quad are inside rect.
+static inline bool isInsideRect(const WindowQuad &quad, const QRectF &rect)
+{
+    if (rect.isEmpty())
+        return false;
+
+    for (int i = 0; i < 4; i++) {
+        const WindowVertex &vertex = quad[i];
+        if (vertex.u() < rect.left() || vertex.u() > rect.right())
+            return false;
+        if (vertex.v() < rect.top() || vertex.v() > rect.bottom())
+            return false;
+    }
+
+    return true;
+}
+
+// Returns the given opaque rect shrunk so that no texel read by a sample
+// inside it, at any level up to opaqueMaximumLevel, is outside the opaque
+// rect. A texel at level n covers 2^n texels of the base level and linear
+// filtering reads one more texel, so samples reach 2^(n+1) texels away.
+static QRectF opaqueSamplingRect(const QRectF &opaqueRect, const QSize &textureSize)
+{
+    if (opaqueRect.isEmpty())
+        return QRectF();
+
+    const qreal margin = 2 << opaqueMaximumLevel;
+    const qreal dx = margin / textureSize.width();
+    const qreal dy = margin / textureSize.height();
+
+    const QRectF rect = opaqueRect.adjusted(dx, dy, -dx, -dy);
+    if (rect.isEmpty())
+        return QRectF();
+
+    return rect;
+}
+
+// Rows of the grid are emitted as triangle strips that share their vertices,
+// disconnected strips are joined with degenerate triangles.
+static void uploadQuads(const WindowQuad *quads, int quadCount,
                         const QMatrix4x4 &textureMatrix, KWin::GLVertex2D *out)
 {
     // Since we know that the texture matrix just scales and translates
@@ -111,153 +126,226 @@ static void uploadQuads(GLenum primitiveType, const QVector<WindowQuad> &quads,
     const QVector2D scale(textureMatrix(0, 0), textureMatrix(1, 1));
     const QVector2D shift(textureMatrix(0, 3), textureMatrix(1, 3));
 
-    switch (primitiveType) {
-    case GL_QUADS:
-#ifdef HAVE_SSE2
-        if (!(intptr_t(out) & 0xf)) {
-            for (int i = 0; i < quads.count(); i++) {
-                const WindowQuad &quad = quads[i];
-                KWIN_ALIGN(16)
-                KWin::GLVertex2D v[4];
-
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
-
-                    v[j].position = QVector2D(wv.x(), wv.y());
-                    v[j].texcoord = QVector2D(wv.u(), wv.v()) * scale + shift;
-                }
-
-                const __m128i *srcP = (const __m128i *)&v;
-                __m128i *dstP = (__m128i *)out;
-
-                _mm_stream_si128(&dstP[0], _mm_load_si128(&srcP[0])); // Top-left
-                _mm_stream_si128(&dstP[1], _mm_load_si128(&srcP[1])); // Top-right
-                _mm_stream_si128(&dstP[2], _mm_load_si128(&srcP[2])); // Bottom-right
-                _mm_stream_si128(&dstP[3], _mm_load_si128(&srcP[3])); // Bottom-left
-
-                out += 4;
-            }
-        } else
-#endif // HAVE_SSE2
-        {
-            for (int i = 0; i < quads.count(); i++) {
-                const WindowQuad &quad = quads[i];
-
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
-
-                    KWin::GLVertex2D v;
-                    v.position = QVector2D(wv.x(), wv.y());
-                    v.texcoord = QVector2D(wv.u(), wv.v()) * scale + shift;
-
-                    *(out++) = v;
-                }
-            }
+    auto vertex = [&scale, &shift](const WindowVertex &wv) {
+        KWin::GLVertex2D v;
+        v.position = QVector2D(wv.x(), wv.y());
+        v.texcoord = QVector2D(wv.u(), wv.v()) * scale + shift;
+        return v;
+    };
+
+    for (int i = 0; i < quadCount; i++) {
+        const WindowQuad &quad = quads[i];
+
+        if (i > 0 && continuesStrip(quads[i - 1], quad)) {
+            *(out++) = vertex(quad[1]); // Top-right
+            *(out++) = vertex(quad[2]); // Bottom-right
+            continue;
         }
-        break;
-
-    case GL_TRIANGLES:
-#ifdef HAVE_SSE2
-        if (!(intptr_t(out) & 0xf)) {
-            for (int i = 0; i < quads.count(); i++) {
-                const WindowQuad &quad = quads[i];
-                KWIN_ALIGN(16) KWin::GLVertex2D v[4];
-
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
-
-                    v[j].position = QVector2D(wv.x(), wv.y());
-                    v[j].texcoord = QVector2D(wv.u(), wv.v()) * scale + shift;
-                }
-
-                const __m128i *srcP = (const __m128i *)&v;
-                __m128i *dstP = (__m128i *)out;
-
-                __m128i src[4];
-                src[0] = _mm_load_si128(&srcP[0]); // Top-left
-                src[1] = _mm_load_si128(&srcP[1]); // Top-right
-                src[2] = _mm_load_si128(&srcP[2]); // Bottom-right
-                src[3] = _mm_load_si128(&srcP[3]); // Bottom-left
-
-                // First triangle
-                _mm_stream_si128(&dstP[0], src[1]); // Top-right
-                _mm_stream_si128(&dstP[1], src[0]); // Top-left
-                _mm_stream_si128(&dstP[2], src[3]); // Bottom-left
-
-                // Second triangle
-                _mm_stream_si128(&dstP[3], src[3]); // Bottom-left
-                _mm_stream_si128(&dstP[4], src[2]); // Bottom-right
-                _mm_stream_si128(&dstP[5], src[1]); // Top-right
-
-                out += 6;
-            }
-        } else
-#endif // HAVE_SSE2
-        {
-            for (int i = 0; i < quads.count(); i++) {
-                const WindowQuad &quad = quads[i];
-                KWin::GLVertex2D v[4]; // Four unique vertices / quad
-
-                for (int j = 0; j < 4; j++) {
-                    const WindowVertex &wv = quad[j];
-
-                    v[j].position = QVector2D(wv.x(), wv.y());
-                    v[j].texcoord = QVector2D(wv.u(), wv.v()) * scale + shift;
-                }
-
-                // First triangle
-                *(out++) = v[1]; // Top-right
-                *(out++) = v[0]; // Top-left
-                *(out++) = v[3]; // Bottom-left
-
-                // Second triangle
-                *(out++) = v[3]; // Bottom-left
-                *(out++) = v[2]; // Bottom-right
-                *(out++) = v[1]; // Top-right
-            }
+
+        if (i > 0) {
+            *out = *(out - 1);
+            out++;
+            *(out++) = vertex(quad[0]);
         }
-        break;
 
-    default:
-        break;
+        *(out++) = vertex(quad[0]); // Top-left
+        *(out++) = vertex(quad[3]); // Bottom-left
+        *(out++) = vertex(quad[1]); // Top-right
+        *(out++) = vertex(quad[2]); // Bottom-right
     }
 }
 
-void WindowMeshRenderer::render(KWin::EffectWindow *window, const QVector<WindowQuad> &quads,
-                                KWin::GLTexture *texture, const QRegion &clipRegion) const
+// Draws the given range of the bound vertex buffer once per rect of region,
+// with the scissor set to the rect.
+static void drawClipped(const QRegion &region, int first, int count)
 {
-    KWin::GLShader *shader = KWin::ShaderManager::instance()->pushShader(KWin::ShaderTrait::MapTexture);
+    const QRect screenGeometry = KWin::GLRenderTarget::virtualScreenGeometry();
+    const qreal scale = KWin::GLRenderTarget::virtualScreenScale();
+
+    for (const QRect &r : region) {
+        glScissor((r.x() - screenGeometry.x()) * scale,
+                  (screenGeometry.height() + screenGeometry.y() - r.y() - r.height()) * scale,
+                  r.width() * scale,
+                  r.height() * scale);
+        glDrawArrays(GL_TRIANGLE_STRIP, first, count);
+    }
+}
 
-    QMatrix4x4 modelViewProjection;
-    const QRect screenRect = KWin::effects->virtualScreenGeometry();
-    modelViewProjection.ortho(0, screenRect.width(), screenRect.height(), 0, 0, 65535);
-    modelViewProjection.translate(window->x(), window->y());
-    shader->setUniform(KWin::GLShader::ModelViewProjectionMatrix, modelViewProjection);
+/*!
+    Uploads the meshes of all windows that are going to be painted in the
+    current frame. All meshes are written with a single map of the vertex
+    ring buffer owned by the renderer.
+*/
+void WindowMeshRenderer::upload(const QVector<MeshUpload> &meshes)
+{
+    m_ranges.clear();
+
+    if (meshes.isEmpty())
+        return;
+
+    if (!m_vertexBuffer) {
+        m_vertexBuffer = new VertexRingBuffer();
+
+        // GL_TEXTURE_MAX_LOD is not available before OpenGL ES 3.0. Without
+        // it, samples can't be kept away from translucent texels, so the
+        // whole mesh is blended.
+        m_lodClampSupported = !KWin::GLPlatform::instance()->isGLES() || KWin::hasGLVersion(3, 0);
+    }
+
+    int totalVertexCount = 0;
+    for (const MeshUpload &mesh : meshes)
+        totalVertexCount += partition(mesh).vertexCount;
 
-    const GLenum primitiveType = KWin::GLVertexBuffer::supportsIndexedQuads() ? GL_QUADS : GL_TRIANGLES;
-    const int verticesPerQuad = primitiveType == GL_QUADS ? 4 : 6;
-    const size_t vboSize = verticesPerQuad * quads.count() * sizeof(KWin::GLVertex2D);
+    if (!totalVertexCount)
+        return;
 
-    KWin::GLVertexBuffer *vbo = KWin::GLVertexBuffer::streamingBuffer();
-    auto map = static_cast<KWin::GLVertex2D *>(vbo->map(vboSize));
-    uploadQuads(primitiveType, quads, texture->matrix(KWin::NormalizedCoordinates), map);
-    vbo->unmap();
+    KWin::GLVertex2D *map = m_vertexBuffer->map(totalVertexCount);
+    if (!map)
+        return;
 
-    vbo->bindArrays();
+    int first = 0;
+    for (const MeshUpload &mesh : meshes) {
+        const QuadPartition &partition = m_partitions[mesh.window];
+        const QMatrix4x4 textureMatrix = mesh.texture->matrix(KWin::NormalizedCoordinates);
+
+        const WindowQuad *opaqueQuads = partition.quads.constData();
+        const int opaqueQuadCount = partition.opaqueQuadCount;
+        uploadQuads(opaqueQuads, opaqueQuadCount, textureMatrix, map + first);
+
+        const WindowQuad *translucentQuads = opaqueQuads + opaqueQuadCount;
+        const int translucentQuadCount = partition.quads.count() - opaqueQuadCount;
+        uploadQuads(translucentQuads, translucentQuadCount, textureMatrix,
+                    map + first + partition.opaqueVertexCount);
+
+        MeshRange range;
+        range.window = mesh.window;
+        range.texture = mesh.texture;
+        range.first = m_vertexBuffer->baseVertex() + first;
+        range.opaqueCount = partition.opaqueVertexCount;
+        range.count = partition.vertexCount;
+        m_ranges.append(range);
+
+        first += range.count;
+    }
+
+    m_vertexBuffer->unmap();
+
+    YAML_TRACE3(mesh_upload, meshes.count(), totalVertexCount,
+                totalVertexCount * sizeof(KWin::GLVertex2D));
+}
+
+/*!
+    Draws the mesh of the given \p window that was uploaded in the current
+    frame, with the texture it was uploaded for.
+*/
+void WindowMeshRenderer::render(KWin::EffectWindow *window, const QPointF &translation,
+                                const QRegion &clipRegion, const QMatrix4x4 &screenProjection) const
+{
+    auto range = std::find_if(m_ranges.constBegin(), m_ranges.constEnd(),
+        [window](const MeshRange &range) { return range.window == window; });
+    if (range == m_ranges.constEnd())
+        return;
+
+    KWin::GLTexture *texture = range->texture;
+
+    KWin::GLShader *shader = KWin::ShaderManager::instance()->pushShader(KWin::ShaderTrait::MapTexture);
+
+    // The screen projection matrix maps global coordinates to the output
+    // that is currently being painted.
+    QMatrix4x4 modelViewProjection = screenProjection;
+    modelViewProjection.translate(window->x() + translation.x(), window->y() + translation.y());
+    shader->setUniform(KWin::GLShader::ModelViewProjectionMatrix, modelViewProjection);
+
+    m_vertexBuffer->bind();
 
     glEnable(GL_SCISSOR_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
     texture->bind();
     texture->generateMipmaps();
-    vbo->draw(clipRegion, primitiveType, 0, verticesPerQuad * quads.count(), true);
+
+    // The opaque part of the mesh doesn't need blending.
+    if (range->opaqueCount) {
+        glTexParameterf(texture->target(), GL_TEXTURE_MAX_LOD, opaqueMaximumLevel);
+        drawClipped(clipRegion, range->first, range->opaqueCount);
+        glTexParameterf(texture->target(), GL_TEXTURE_MAX_LOD, 1000.0f);
+    }
+
+    const int translucentCount = range->count - range->opaqueCount;
+    if (translucentCount) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        drawClipped(clipRegion, range->first + range->opaqueCount, translucentCount);
+        glDisable(GL_BLEND);
+    }
+
     texture->unbind();
 
-    glDisable(GL_BLEND);
     glDisable(GL_SCISSOR_TEST);
 
-    vbo->unbindArrays();
+    m_vertexBuffer->unbind();
 
     KWin::ShaderManager::instance()->popShader();
 }
+
+/*!
+    Marks the end of the current frame. Must be called once all meshes
+    uploaded in the frame have been drawn.
+*/
+void WindowMeshRenderer::endFrame()
+{
+    if (m_vertexBuffer)
+        m_vertexBuffer->endFrame();
+}
+
+/*!
+    Forgets the mesh of the given \p window.
+*/
+void WindowMeshRenderer::unregisterWindow(KWin::EffectWindow *window)
+{
+    m_partitions.remove(window);
+}
+
+/*!
+    Forgets the meshes of all windows.
+*/
+void WindowMeshRenderer::unregisterAllWindows()
+{
+    m_partitions.clear();
+}
+
+// Opaque quads of each mesh are put in front of its translucent quads, so
+// they can be drawn without blending. The partition is only redone when the
+// mesh has been rebuilt or the opaque part of the texture has changed.
+const WindowMeshRenderer::QuadPartition &WindowMeshRenderer::partition(const MeshUpload &mesh)
+{
+    const QRectF opaqueRect = m_lodClampSupported
+        ? opaqueSamplingRect(mesh.opaqueRect, mesh.texture->size())
+        : QRectF();
+
+    QuadPartition &partition = m_partitions[mesh.window];
+    if (partition.meshSerial == mesh.meshSerial && partition.opaqueRect == opaqueRect)
+        return partition;
+
+    partition.meshSerial = mesh.meshSerial;
+    partition.opaqueRect = opaqueRect;
+    partition.quads.clear();
+
+    for (const WindowQuad &quad : *mesh.quads) {
+        if (isInsideRect(quad, opaqueRect))
+            partition.quads.append(quad);
+    }
+    partition.opaqueQuadCount = partition.quads.count();
+
+    for (const WindowQuad &quad : *mesh.quads) {
+        if (!isInsideRect(quad, opaqueRect))
+            partition.quads.append(quad);
+    }
+
+    const WindowQuad *quads = partition.quads.constData();
+    partition.opaqueVertexCount = stripVertexCount(quads, partition.opaqueQuadCount);
+    partition.vertexCount = partition.opaqueVertexCount
+        + stripVertexCount(quads + partition.opaqueQuadCount,
+                           partition.quads.count() - partition.opaqueQuadCount);
+
+    return partition;
+}
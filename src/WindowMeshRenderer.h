@@ -18,13 +18,17 @@
 #pragma once
 
 // Own
+#include "VertexRingBuffer.h"
 #include "WindowQuad.h"
 
 // kwineffects
 #include <kwineffects.h>
 #include <kwingltexture.h>
+#include <kwinglutils.h>
 
 // Qt
+#include <QHash>
+#include <QRectF>
 #include <QVector>
 
 class WindowMeshRenderer : public QObject
@@ -32,10 +36,63 @@ class WindowMeshRenderer : public QObject
     Q_OBJECT
 
 public:
+    struct MeshUpload
+    {
+        KWin::EffectWindow *window;
+        const QVector<WindowQuad> *quads;
+        KWin::GLTexture *texture;
+
+        // Identifies the contents of quads, see Model::meshSerial().
+        quint64 meshSerial;
+
+        // The part of the texture known to be opaque, in normalized coordinates.
+        QRectF opaqueRect;
+    };
+
     explicit WindowMeshRenderer(QObject *parent = nullptr);
+    ~WindowMeshRenderer() override;
+
+    void upload(const QVector<MeshUpload> &meshes);
+
+    void render(KWin::EffectWindow *window, const QPointF &translation,
+                const QRegion &clipRegion, const QMatrix4x4 &screenProjection) const;
+
+    void endFrame();
+
+    void unregisterWindow(KWin::EffectWindow *window);
+    void unregisterAllWindows();
+
+private:
+    struct MeshRange
+    {
+        KWin::EffectWindow *window;
+
+        // The texture the mesh has been uploaded for.
+        KWin::GLTexture *texture;
+        int first;
+        int opaqueCount;
+        int count;
+    };
+
+    struct QuadPartition
+    {
+        // What the partition was made from.
+        quint64 meshSerial = 0;
+        QRectF opaqueRect;
+
+        // The quads of the mesh, opaque quads first.
+        QVector<WindowQuad> quads;
+        int opaqueQuadCount = 0;
+        int opaqueVertexCount = 0;
+        int vertexCount = 0;
+    };
+
+    const QuadPartition &partition(const MeshUpload &mesh);
 
-    QVector<WindowQuad> makeGrid(const KWin::EffectWindow *window, int blockSize);
+    VertexRingBuffer *m_vertexBuffer = nullptr;
+    bool m_lodClampSupported = false;
+    QVector<MeshRange> m_ranges;
+    QHash<KWin::EffectWindow *, QuadPartition> m_partitions;
 
-    void render(KWin::EffectWindow *window, const QVector<WindowQuad> &quads,
-                KWin::GLTexture *texture, const QRegion &clipRegion) const;
+    Q_DISABLE_COPY(WindowMeshRenderer)
 };
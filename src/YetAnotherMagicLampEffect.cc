@@ -17,16 +17,24 @@
 
 // Own
 #include "YetAnotherMagicLampEffect.h"
+#include "DockIndex.h"
 #include "Model.h"
 #include "OffscreenRenderer.h"
+#include "SoftwareOffscreenRenderer.h"
 #include "WindowMeshRenderer.h"
 
 // Auto-generated
 #include "YetAnotherMagicLampConfig.h"
 
+// Qt
+#include <QPainter>
+
 // std
 #include <cmath>
 
+// The lowest grid resolution used when the mesh quality is reduced.
+static const int minimumReducedGridResolution = 4;
+
 enum ShapeCurve {
     Linear = 0,
     Quad = 1,
@@ -42,6 +50,13 @@ enum ShapeCurve {
 YetAnotherMagicLampEffect::YetAnotherMagicLampEffect()
     : m_lastPresentTime(std::chrono::milliseconds::zero())
 {
+    m_dockIndex = new DockIndex(this);
+    m_offscreenRenderer = new OffscreenRenderer(this);
+    m_meshRenderer = new WindowMeshRenderer(this);
+
+    m_softwareRendering = !KWin::effects->isOpenGLCompositing();
+    m_softwareOffscreenRenderer = new SoftwareOffscreenRenderer(this);
+
     reconfigure(ReconfigureAll);
 
     connect(KWin::effects, &KWin::EffectsHandler::windowMinimized,
@@ -52,9 +67,6 @@ YetAnotherMagicLampEffect::YetAnotherMagicLampEffect()
         this, &YetAnotherMagicLampEffect::slotWindowDeleted);
     connect(KWin::effects, &KWin::EffectsHandler::activeFullScreenEffectChanged,
         this, &YetAnotherMagicLampEffect::slotActiveFullScreenEffectChanged);
-
-    m_offscreenRenderer = new OffscreenRenderer(this);
-    m_meshRenderer = new WindowMeshRenderer(this);
 }
 
 YetAnotherMagicLampEffect::~YetAnotherMagicLampEffect()
@@ -124,6 +136,10 @@ void YetAnotherMagicLampEffect::reconfigure(ReconfigureFlags flags)
     m_modelParameters.bumpDuration = std::chrono::milliseconds(baseDuration);
     m_modelParameters.shapeFactor = YetAnotherMagicLampConfig::initialShapeFactor();
     m_modelParameters.bumpDistance = YetAnotherMagicLampConfig::maxBumpDistance();
+    m_modelParameters.excludeShadows = YetAnotherMagicLampConfig::excludeShadows();
+
+    m_offscreenRenderer->setShadowsExcluded(m_modelParameters.excludeShadows);
+    m_softwareOffscreenRenderer->setShadowsExcluded(m_modelParameters.excludeShadows);
 
     m_gridResolution = YetAnotherMagicLampConfig::gridResolution();
 }
@@ -139,25 +155,99 @@ void YetAnotherMagicLampEffect::prePaintScreen(KWin::ScreenPrePaintData& data, s
         model.step(delta);
     }
 
+    admitPendingAnimations(delta);
+
+    if (delta.count() && !m_models.isEmpty()) {
+        m_governor.update(delta);
+        applyQualityLevel();
+    }
+
     data.mask |= PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS;
 
     KWin::effects->prePaintScreen(data, presentTime);
 }
 
+void YetAnotherMagicLampEffect::paintScreen(int mask, const QRegion& region, KWin::ScreenPaintData& data)
+{
+    // The output geometry is only set if outputs are painted one by one.
+    m_outputGeometry = data.outputGeometry();
+
+    if (m_softwareRendering) {
+        // Windows are rendered into their offscreen images while the scene
+        // painter doesn't have any per-window state yet.
+        for (auto modelIt = m_models.begin(); modelIt != m_models.end(); ++modelIt) {
+            if (isPaintedOnOutput(*modelIt) && !m_directlyRenderedWindows.contains(modelIt.key())) {
+                m_softwareOffscreenRenderer->render(modelIt.key());
+            }
+        }
+
+        KWin::effects->paintScreen(mask, region, data);
+        return;
+    }
+
+    // Upload the meshes of all windows painted on this output at once.
+    m_meshUploads.clear();
+    for (auto modelIt = m_models.begin(); modelIt != m_models.end(); ++modelIt) {
+        if (!isPaintedOnOutput(*modelIt) || m_directlyRenderedWindows.contains(modelIt.key())) {
+            continue;
+        }
+
+        // The texture is chosen once per frame, so the mesh is uploaded for
+        // the texture that is drawn.
+        KWin::GLTexture* texture = m_offscreenRenderer->prepare(modelIt.key());
+        if (!texture) {
+            continue;
+        }
+
+        WindowMeshRenderer::MeshUpload upload;
+        upload.window = modelIt.key();
+        upload.quads = &(*modelIt).mesh(effectiveGridResolution());
+        upload.meshSerial = (*modelIt).meshSerial();
+        upload.texture = texture;
+        upload.opaqueRect = m_offscreenRenderer->opaqueRect(modelIt.key());
+        m_meshUploads.append(upload);
+    }
+    m_meshRenderer->upload(m_meshUploads);
+
+    KWin::effects->paintScreen(mask, region, data);
+}
+
 void YetAnotherMagicLampEffect::postPaintScreen()
 {
+    // Everything uploaded for this frame has been drawn.
+    if (!m_softwareRendering) {
+        m_meshRenderer->endFrame();
+        m_offscreenRenderer->endFrame();
+    }
+
     auto modelIt = m_models.begin();
     while (modelIt != m_models.end()) {
         if ((*modelIt).done()) {
-            m_offscreenRenderer->unregisterWindow(modelIt.key());
+            // Directly rendered windows have nothing to clean up offscreen.
+            if (!m_directlyRenderedWindows.remove(modelIt.key())) {
+                if (m_softwareRendering) {
+                    m_softwareOffscreenRenderer->unregisterWindow(modelIt.key());
+                } else {
+                    if ((*modelIt).kind() == Model::AnimationKind::Minimize) {
+                        m_offscreenRenderer->storeSnapshot(modelIt.key());
+                    }
+                    m_offscreenRenderer->unregisterWindow(modelIt.key());
+                    m_meshRenderer->unregisterWindow(modelIt.key());
+                }
+            }
             modelIt = m_models.erase(modelIt);
         } else {
             ++modelIt;
         }
     }
 
-    if (m_models.isEmpty())
+    updateSubscriptions();
+
+    if (m_models.isEmpty() && m_scheduler.isEmpty()) {
         m_lastPresentTime = std::chrono::milliseconds::zero();
+        m_governor.reset();
+        applyQualityLevel();
+    }
 
     KWin::effects->addRepaintFull();
     KWin::effects->postPaintScreen();
@@ -168,6 +258,27 @@ void YetAnotherMagicLampEffect::prePaintWindow(KWin::EffectWindow* w, KWin::Wind
     auto modelIt = m_models.constFind(w);
     if (modelIt != m_models.constEnd()) {
         w->enablePainting(KWin::EffectWindow::PAINT_DISABLED_BY_MINIMIZE);
+#ifdef YAML_HAVE_DIRECT_RENDERING
+        if (m_directlyRenderedWindows.contains(w)) {
+            if (m_modelParameters.excludeShadows) {
+                data.quads = data.quads.filterOut(KWin::WindowQuadShadow);
+            }
+            const int gridResolution = effectiveGridResolution();
+            data.quads = data.quads.makeRegularGrid(gridResolution, gridResolution);
+            data.setTransformed();
+        }
+#endif
+    } else if (!m_scheduler.isEmpty()) {
+        // Windows waiting for their animation to start keep the state they
+        // had before they were minimized or unminimized.
+        const AnimationScheduler::PendingAnimation* pending = m_scheduler.find(w);
+        if (pending) {
+            if (pending->kind == Model::AnimationKind::Minimize) {
+                w->enablePainting(KWin::EffectWindow::PAINT_DISABLED_BY_MINIMIZE);
+            } else {
+                w->disablePainting(KWin::EffectWindow::PAINT_DISABLED_BY_MINIMIZE);
+            }
+        }
     }
 
     KWin::effects->prePaintWindow(w, data, presentTime);
@@ -175,28 +286,120 @@ void YetAnotherMagicLampEffect::prePaintWindow(KWin::EffectWindow* w, KWin::Wind
 
 void YetAnotherMagicLampEffect::drawWindow(KWin::EffectWindow* w, int mask, const QRegion& region, KWin::WindowPaintData& data)
 {
-    auto modelIt = m_models.constFind(w);
-    if (modelIt == m_models.constEnd()) {
+    auto modelIt = m_models.find(w);
+    if (modelIt == m_models.end()) {
         KWin::effects->drawWindow(w, mask, region, data);
         return;
     }
 
-    KWin::GLTexture* texture = m_offscreenRenderer->render(w);
-    QVector<WindowQuad> quads = m_meshRenderer->makeGrid(w, m_gridResolution);
-    (*modelIt).apply(quads);
+    // With per-output rendering, skip the window entirely if it's animating
+    // on another output.
+    if (!isPaintedOnOutput(*modelIt) || !region.intersects((*modelIt).boundingRect())) {
+        return;
+    }
+
+#ifdef YAML_HAVE_DIRECT_RENDERING
+    if (m_directlyRenderedWindows.contains(w)) {
+        // The scene clips transformed windows to the painted region.
+        (*modelIt).apply(data.quads);
+        if ((*modelIt).needsClip()) {
+            KWin::effects->drawWindow(w, mask, clipToModel(*modelIt, region), data);
+        } else {
+            KWin::effects->drawWindow(w, mask, region, data);
+        }
+        return;
+    }
+#endif
 
+    // The mesh is uploaded once per frame and drawn once per rect of the
+    // clip region with a scissor, so clip against the model analytically
+    // first to drop the rects the window doesn't reach.
     QRegion clipRegion = region;
-
     if ((*modelIt).needsClip()) {
-        clipRegion = (*modelIt).clipRegion();
+        clipRegion = clipToModel(*modelIt, region);
     }
 
-    m_meshRenderer->render(w, quads, texture, clipRegion);
+    if (m_softwareRendering) {
+        const QImage* image = m_softwareOffscreenRenderer->image(w);
+        if (image) {
+            drawWindowInSoftware(*modelIt, *image, clipRegion);
+        }
+        return;
+    }
+
+    m_offscreenRenderer->render(w);
+    m_meshRenderer->render(w, (*modelIt).translation(), clipRegion,
+        data.screenProjectionMatrix());
+}
+
+void YetAnotherMagicLampEffect::drawWindowInSoftware(Model& model, const QImage& image, const QRegion& region)
+{
+    // The mesh is rasterized into a scratch image that covers only the
+    // painted part of the window, so the cost is bounded by the repainted
+    // area rather than by the size of the output.
+    const QRect paintRect = region.boundingRect() & model.boundingRect();
+    if (paintRect.isEmpty()) {
+        return;
+    }
+
+    if (m_softwareFrame.width() < paintRect.width() || m_softwareFrame.height() < paintRect.height()) {
+        m_softwareFrame = QImage(paintRect.size().expandedTo(m_softwareFrame.size()),
+            QImage::Format_ARGB32_Premultiplied);
+    }
+
+    // The scratch image is only grown, so a frame is a view into it.
+    QImage frame(m_softwareFrame.bits(), paintRect.width(), paintRect.height(),
+        m_softwareFrame.bytesPerLine(), QImage::Format_ARGB32_Premultiplied);
+    frame.fill(Qt::transparent);
+
+    const QPointF position = model.window()->pos() + model.translation();
+    m_softwareMeshRenderer.render(&frame, paintRect.topLeft(), model.mesh(effectiveGridResolution()),
+        position, image, region);
+
+    KWin::effects->scenePainter()->drawImage(paintRect.topLeft(), frame);
+}
+
+bool YetAnotherMagicLampEffect::isPaintedOnOutput(const Model& model) const
+{
+    return m_outputGeometry.isNull() || m_outputGeometry.intersects(model.boundingRect());
+}
+
+QRegion YetAnotherMagicLampEffect::clipToModel(const Model& model, const QRegion& region) const
+{
+    // While windows are animating the whole screen is repainted, so the
+    // painted region usually covers the clip rect. Use the region cached by
+    // the model in that case instead of allocating a new one.
+    const QRect clipRect = model.clipRect();
+    if (region.rectCount() == 1 && region.boundingRect().contains(clipRect)) {
+        return model.clipRegion();
+    }
+    return region.intersected(clipRect);
+}
+
+bool YetAnotherMagicLampEffect::canRenderDirectly(KWin::EffectWindow* w) const
+{
+#ifdef YAML_HAVE_DIRECT_RENDERING
+    // Without the offscreen pass, the window is not mipmapped and its
+    // decoration and shadow are deformed as separate sets of quads. Only
+    // plain windows look the same either way. The QPainter scene doesn't
+    // deform window quads at all.
+    return !m_softwareRendering
+        && !w->hasDecoration()
+        && (m_modelParameters.excludeShadows || w->expandedGeometry() == w->geometry());
+#else
+    Q_UNUSED(w)
+    return false;
+#endif
 }
 
 bool YetAnotherMagicLampEffect::isActive() const
 {
-    return !m_models.isEmpty();
+    return !m_models.isEmpty() || !m_scheduler.isEmpty();
+}
+
+int YetAnotherMagicLampEffect::qualityLevel() const
+{
+    return static_cast<int>(m_governor.level());
 }
 
 bool YetAnotherMagicLampEffect::supported()
@@ -207,60 +410,143 @@ bool YetAnotherMagicLampEffect::supported()
     if (KWin::effects->isOpenGLCompositing()) {
         return true;
     }
+    if (KWin::effects->compositingType() == KWin::QPainterCompositing) {
+        return true;
+    }
     return false;
 }
 
 void YetAnotherMagicLampEffect::slotWindowMinimized(KWin::EffectWindow* w)
+{
+    scheduleAnimation(w, Model::AnimationKind::Minimize);
+}
+
+void YetAnotherMagicLampEffect::slotWindowUnminimized(KWin::EffectWindow* w)
+{
+    scheduleAnimation(w, Model::AnimationKind::Unminimize);
+}
+
+void YetAnotherMagicLampEffect::scheduleAnimation(KWin::EffectWindow* w, Model::AnimationKind kind)
 {
     if (KWin::effects->activeFullScreenEffect()) {
         return;
     }
 
-    const QRect iconRect = w->iconGeometry();
-    if (!iconRect.isValid()) {
+    auto modelIt = m_models.find(w);
+    Model* model = modelIt != m_models.end() ? &(*modelIt) : nullptr;
+
+    // The animation is started in the next prePaintScreen, see
+    // admitPendingAnimations().
+    const QRect expandedGeometry = w->expandedGeometry();
+    const AnimationScheduler::RequestResult result = m_scheduler.request(w, kind, model,
+        w->iconGeometry().isValid(), qint64(expandedGeometry.width()) * expandedGeometry.height());
+
+    if (result == AnimationScheduler::RequestResult::Reversed
+        || result == AnimationScheduler::RequestResult::Scheduled) {
+        KWin::effects->addRepaintFull();
+    }
+}
+
+void YetAnotherMagicLampEffect::applyQualityLevel()
+{
+    const QualityGovernor::Level level = m_governor.level();
+    if (level == m_appliedQualityLevel) {
         return;
     }
+    m_appliedQualityLevel = level;
 
-    Model& model = m_models[w];
-    model.setWindow(w);
-    model.setParameters(m_modelParameters);
-    model.start(Model::AnimationKind::Minimize);
+    // Damaged windows are not re-rendered, the animation continues with
+    // the last rendered contents.
+    m_offscreenRenderer->setLiveUpdatesEnabled(level < QualityGovernor::Level::FrozenContent);
+    m_softwareOffscreenRenderer->setLiveUpdatesEnabled(level < QualityGovernor::Level::FrozenContent);
 
-    m_offscreenRenderer->registerWindow(w);
+    // Only windows that start animating from now on get smaller textures.
+    const qreal textureScale = level < QualityGovernor::Level::ReducedTextures ? 1.0 : 0.5;
+    m_offscreenRenderer->setTextureScale(textureScale);
+    m_softwareOffscreenRenderer->setTextureScale(textureScale);
 
-    KWin::effects->addRepaintFull();
+    Q_EMIT qualityLevelChanged();
 }
 
-void YetAnotherMagicLampEffect::slotWindowUnminimized(KWin::EffectWindow* w)
+int YetAnotherMagicLampEffect::effectiveGridResolution() const
 {
-    if (KWin::effects->activeFullScreenEffect()) {
-        return;
+    if (m_governor.level() < QualityGovernor::Level::ReducedMesh) {
+        return m_gridResolution;
     }
+    return qMax(m_gridResolution / 2, minimumReducedGridResolution);
+}
 
-    const QRect iconRect = w->iconGeometry();
-    if (!iconRect.isValid()) {
-        return;
+void YetAnotherMagicLampEffect::admitPendingAnimations(std::chrono::milliseconds delta)
+{
+    m_scheduler.admit(delta, m_admittedAnimations);
+    for (const AnimationScheduler::PendingAnimation& pending : m_admittedAnimations) {
+        startAnimation(pending.window, pending.kind);
     }
+}
 
+void YetAnotherMagicLampEffect::startAnimation(KWin::EffectWindow* w, Model::AnimationKind kind)
+{
     Model& model = m_models[w];
     model.setWindow(w);
+    model.setDockIndex(m_dockIndex);
     model.setParameters(m_modelParameters);
-    model.start(Model::AnimationKind::Unminimize);
 
-    m_offscreenRenderer->registerWindow(w);
+    // The dock index has to be up to date before the model looks up the
+    // dock the icon belongs to.
+    updateSubscriptions();
 
-    KWin::effects->addRepaintFull();
+    model.start(kind);
+
+    if (canRenderDirectly(w)) {
+        m_directlyRenderedWindows.insert(w);
+    } else if (m_softwareRendering) {
+        m_softwareOffscreenRenderer->registerWindow(w);
+    } else {
+        m_offscreenRenderer->registerWindow(w);
+    }
+}
+
+void YetAnotherMagicLampEffect::updateSubscriptions()
+{
+    // Geometry changes only matter while windows are animating.
+    m_dockIndex->setTracking(!m_models.isEmpty());
+
+    if (m_models.isEmpty()) {
+        disconnect(m_windowGeometryShapeChangedConnection);
+        m_windowGeometryShapeChangedConnection = QMetaObject::Connection();
+    } else if (!m_windowGeometryShapeChangedConnection) {
+        m_windowGeometryShapeChangedConnection = connect(KWin::effects, &KWin::EffectsHandler::windowGeometryShapeChanged,
+            this, &YetAnotherMagicLampEffect::slotWindowGeometryShapeChanged);
+    }
 }
 
 void YetAnotherMagicLampEffect::slotWindowDeleted(KWin::EffectWindow* w)
 {
     m_models.remove(w);
+    m_directlyRenderedWindows.remove(w);
+    m_meshRenderer->unregisterWindow(w);
+    updateSubscriptions();
+
+    m_scheduler.remove(w);
+}
+
+void YetAnotherMagicLampEffect::slotWindowGeometryShapeChanged(KWin::EffectWindow* w)
+{
+    auto modelIt = m_models.find(w);
+    if (modelIt != m_models.end()) {
+        (*modelIt).updateGeometry();
+    }
 }
 
 void YetAnotherMagicLampEffect::slotActiveFullScreenEffectChanged()
 {
     if (KWin::effects->activeFullScreenEffect() != nullptr) {
         m_offscreenRenderer->unregisterAllWindows();
+        m_softwareOffscreenRenderer->unregisterAllWindows();
+        m_meshRenderer->unregisterAllWindows();
         m_models.clear();
+        m_scheduler.clear();
+        m_directlyRenderedWindows.clear();
+        updateSubscriptions();
     }
 }
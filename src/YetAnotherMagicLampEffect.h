@@ -18,17 +18,31 @@
 #pragma once
 
 // Own
+#include "AnimationScheduler.h"
 #include "Model.h"
+#include "QualityGovernor.h"
+#include "SoftwareMeshRenderer.h"
+#include "WindowMeshRenderer.h"
 #include "common.h"
 
 // kwineffects
 #include <kwineffects.h>
 
+// Qt
+#include <QSet>
+
+// Window quads can be deformed through the paint data up to KWin 5.23.
+#if KWIN_EFFECT_API_VERSION < KWIN_EFFECT_API_MAKE_VERSION(0, 233)
+#define YAML_HAVE_DIRECT_RENDERING
+#endif
+
+class DockIndex;
 class OffscreenRenderer;
-class WindowMeshRenderer;
+class SoftwareOffscreenRenderer;
 
 class YetAnotherMagicLampEffect : public KWin::Effect {
     Q_OBJECT
+    Q_PROPERTY(int qualityLevel READ qualityLevel NOTIFY qualityLevelChanged)
 
 public:
     YetAnotherMagicLampEffect();
@@ -37,6 +51,7 @@ public:
     void reconfigure(ReconfigureFlags flags) override;
 
     void prePaintScreen(KWin::ScreenPrePaintData& data, std::chrono::milliseconds presentTime) override;
+    void paintScreen(int mask, const QRegion& region, KWin::ScreenPaintData& data) override;
     void postPaintScreen() override;
 
     void prePaintWindow(KWin::EffectWindow* w, KWin::WindowPrePaintData& data, std::chrono::milliseconds presentTime) override;
@@ -48,20 +63,52 @@ public:
 
     static bool supported();
 
+    int qualityLevel() const;
+
+Q_SIGNALS:
+    void qualityLevelChanged();
+
 private Q_SLOTS:
     void slotWindowMinimized(KWin::EffectWindow* w);
     void slotWindowUnminimized(KWin::EffectWindow* w);
     void slotWindowDeleted(KWin::EffectWindow* w);
+    void slotWindowGeometryShapeChanged(KWin::EffectWindow* w);
     void slotActiveFullScreenEffectChanged();
 
 private:
+    void scheduleAnimation(KWin::EffectWindow* w, Model::AnimationKind kind);
+    void admitPendingAnimations(std::chrono::milliseconds delta);
+    void startAnimation(KWin::EffectWindow* w, Model::AnimationKind kind);
+    bool isPaintedOnOutput(const Model& model) const;
+    QRegion clipToModel(const Model& model, const QRegion& region) const;
+    bool canRenderDirectly(KWin::EffectWindow* w) const;
+    void drawWindowInSoftware(Model& model, const QImage& image, const QRegion& region);
+    void updateSubscriptions();
+    void applyQualityLevel();
+    int effectiveGridResolution() const;
+
     Model::Parameters m_modelParameters;
     int m_gridResolution;
     std::chrono::milliseconds m_lastPresentTime;
+    QRect m_outputGeometry;
+    QualityGovernor m_governor;
+    QualityGovernor::Level m_appliedQualityLevel = QualityGovernor::Level::Full;
 
     QMap<KWin::EffectWindow*, Model> m_models;
+    AnimationScheduler m_scheduler;
+    QVector<AnimationScheduler::PendingAnimation> m_admittedAnimations;
+    QSet<KWin::EffectWindow*> m_directlyRenderedWindows;
+    QMetaObject::Connection m_windowGeometryShapeChangedConnection;
+    QVector<WindowMeshRenderer::MeshUpload> m_meshUploads;
+    DockIndex* m_dockIndex;
     OffscreenRenderer* m_offscreenRenderer;
     WindowMeshRenderer* m_meshRenderer;
+
+    // Used instead of the OpenGL renderers with QPainter compositing.
+    bool m_softwareRendering;
+    SoftwareOffscreenRenderer* m_softwareOffscreenRenderer;
+    SoftwareMeshRenderer m_softwareMeshRenderer;
+    QImage m_softwareFrame;
 };
 
 inline int YetAnotherMagicLampEffect::requestedEffectChainPosition() const
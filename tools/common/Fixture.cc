@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "Fixture.h"
+
+// Qt
+#include <QPainter>
+#include <QStringList>
+
+Model::Parameters defaultModelParameters()
+{
+    // Same as the defaults in YetAnotherMagicLampEffect::reconfigure().
+    Model::Parameters parameters;
+    parameters.squashDuration = std::chrono::milliseconds(300);
+    parameters.stretchDuration = std::chrono::milliseconds(210);
+    parameters.bumpDuration = std::chrono::milliseconds(300);
+    parameters.shapeCurve = QEasingCurve(QEasingCurve::InOutSine);
+    parameters.shapeFactor = 0.2;
+    parameters.bumpDistance = 30;
+    parameters.excludeShadows = false;
+    return parameters;
+}
+
+QRect iconRectForDirection(Direction direction, const QRect& screenRect)
+{
+    // Put a 48x48 icon in the middle of a 48px thick panel.
+    const int iconSize = 48;
+    const QPoint center = screenRect.center();
+
+    switch (direction) {
+    case Direction::Left:
+        return QRect(screenRect.left(), center.y() - iconSize / 2, iconSize, iconSize);
+
+    case Direction::Top:
+        return QRect(center.x() - iconSize / 2, screenRect.top(), iconSize, iconSize);
+
+    case Direction::Right:
+        return QRect(screenRect.right() - iconSize + 1, center.y() - iconSize / 2, iconSize, iconSize);
+
+    case Direction::Bottom:
+        return QRect(center.x() - iconSize / 2, screenRect.bottom() - iconSize + 1, iconSize, iconSize);
+
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+Model::Geometry makeGeometry(Direction direction, const QSize& screenSize,
+    const QSize& windowSize, int shadowSize)
+{
+    Model::Geometry geometry;
+    geometry.direction = direction;
+    geometry.screenRect = QRect(QPoint(0, 0), screenSize);
+    geometry.windowRect = QRect(QPoint(0, 0), windowSize);
+    geometry.windowRect.moveCenter(geometry.screenRect.center());
+    geometry.expandedRect = geometry.windowRect.adjusted(-shadowSize, -shadowSize, shadowSize, shadowSize);
+    geometry.iconRect = iconRectForDirection(direction, geometry.screenRect);
+    return geometry;
+}
+
+Model::Geometry makeOverlappingGeometry(Direction direction)
+{
+    Model::Geometry geometry = makeGeometry(direction, QSize(1920, 1080), QSize(800, 600), 30);
+
+    // The window overlaps the panel by 20px, so minimizing it starts with
+    // the bump stage.
+    QPoint offset;
+    switch (direction) {
+    case Direction::Left:
+        offset.setX(geometry.iconRect.right() - 20 - geometry.windowRect.left());
+        break;
+
+    case Direction::Top:
+        offset.setY(geometry.iconRect.bottom() - 20 - geometry.windowRect.top());
+        break;
+
+    case Direction::Right:
+        offset.setX(geometry.iconRect.left() + 20 - geometry.windowRect.right());
+        break;
+
+    case Direction::Bottom:
+        offset.setY(geometry.iconRect.top() + 20 - geometry.windowRect.bottom());
+        break;
+    }
+
+    geometry.windowRect.translate(offset);
+    geometry.expandedRect.translate(offset);
+    return geometry;
+}
+
+std::chrono::milliseconds nominalDuration(const Model::Parameters& parameters,
+    const Model::Geometry& geometry, Model::AnimationKind kind)
+{
+    Model model;
+    model.setParameters(parameters);
+    model.setGeometry(geometry);
+    model.start(kind);
+
+    std::chrono::milliseconds duration = std::chrono::milliseconds::zero();
+    while (!model.done()) {
+        model.step(std::chrono::milliseconds(1));
+        duration += std::chrono::milliseconds(1);
+    }
+
+    return duration;
+}
+
+QImage makeCheckerboard(const QSize& size)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    const int cellSize = 32;
+    for (int y = 0; y < size.height(); y += cellSize) {
+        for (int x = (y / cellSize) % 2 * cellSize; x < size.width(); x += 2 * cellSize) {
+            painter.fillRect(x, y, cellSize, cellSize, QColor(0x3d, 0xae, 0xe9));
+        }
+    }
+    painter.setPen(Qt::black);
+    painter.drawRect(image.rect().adjusted(0, 0, -1, -1));
+
+    return image;
+}
+
+bool parseDirection(const QString& name, Direction* direction)
+{
+    if (name == QLatin1String("left")) {
+        *direction = Direction::Left;
+    } else if (name == QLatin1String("top")) {
+        *direction = Direction::Top;
+    } else if (name == QLatin1String("right")) {
+        *direction = Direction::Right;
+    } else if (name == QLatin1String("bottom")) {
+        *direction = Direction::Bottom;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseCurve(const QString& name, QEasingCurve* curve)
+{
+    if (name == QLatin1String("linear")) {
+        curve->setType(QEasingCurve::Linear);
+    } else if (name == QLatin1String("quad")) {
+        curve->setType(QEasingCurve::InOutQuad);
+    } else if (name == QLatin1String("cubic")) {
+        curve->setType(QEasingCurve::InOutCubic);
+    } else if (name == QLatin1String("quart")) {
+        curve->setType(QEasingCurve::InOutQuart);
+    } else if (name == QLatin1String("quint")) {
+        curve->setType(QEasingCurve::InOutQuint);
+    } else if (name == QLatin1String("sine")) {
+        curve->setType(QEasingCurve::InOutSine);
+    } else if (name == QLatin1String("circ")) {
+        curve->setType(QEasingCurve::InOutCirc);
+    } else if (name == QLatin1String("bounce")) {
+        curve->setType(QEasingCurve::InOutBounce);
+    } else if (name == QLatin1String("bezier")) {
+        // Same as in YetAnotherMagicLampEffect::reconfigure().
+        curve->setType(QEasingCurve::BezierSpline);
+        curve->addCubicBezierSegment(
+            QPointF(0.3, 0.0),
+            QPointF(0.7, 1.0),
+            QPointF(1.0, 1.0));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseSize(const QString& text, QSize* size)
+{
+    const QStringList parts = text.split(QLatin1Char('x'));
+    if (parts.count() != 2) {
+        return false;
+    }
+
+    bool widthOk = false;
+    bool heightOk = false;
+    size->setWidth(parts[0].toInt(&widthOk));
+    size->setHeight(parts[1].toInt(&heightOk));
+
+    return widthOk && heightOk && !size->isEmpty();
+}
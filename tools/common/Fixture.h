@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Own
+#include "Model.h"
+
+// Qt
+#include <QImage>
+#include <QSize>
+
+/**
+ * Fixtures shared by the developer tools and the autotests. They drive the
+ * model through geometry snapshots, so no compositor is needed.
+ **/
+
+/**
+ * Returns the model parameters that the effect uses by default.
+ **/
+Model::Parameters defaultModelParameters();
+
+/**
+ * Returns the geometry of the icon in the middle of a 48px thick panel
+ * along the given edge of the screen.
+ **/
+QRect iconRectForDirection(Direction direction, const QRect& screenRect);
+
+/**
+ * Returns a geometry snapshot of a window centered on the screen, with the
+ * icon on the panel in the given direction.
+ *
+ * @param shadowSize How far the shadow extends beyond the window.
+ **/
+Model::Geometry makeGeometry(Direction direction, const QSize& screenSize,
+    const QSize& windowSize, int shadowSize = 0);
+
+/**
+ * Returns a geometry snapshot of a window with a shadow that overlaps the
+ * panel, so minimizing it goes through every stage of the animation.
+ **/
+Model::Geometry makeOverlappingGeometry(Direction direction);
+
+/**
+ * Returns how long the animation takes if frames are never late. The model
+ * is stepped a millisecond at a time.
+ **/
+std::chrono::milliseconds nominalDuration(const Model::Parameters& parameters,
+    const Model::Geometry& geometry, Model::AnimationKind kind);
+
+/**
+ * Returns a checkerboard image that can be used as the contents of a window.
+ **/
+QImage makeCheckerboard(const QSize& size);
+
+bool parseDirection(const QString& name, Direction* direction);
+bool parseCurve(const QString& name, QEasingCurve* curve);
+bool parseSize(const QString& text, QSize* size);
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "Fixture.h"
+#include "Model.h"
+#include "SoftwareMeshRenderer.h"
+
+// Qt
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QTextStream>
+
+/**
+ * Renders the frames of a magic lamp animation without OpenGL and writes
+ * them to PNG files. The frames can be compared against golden images, and
+ * with --benchmark the tool reports how long it takes to rasterize them.
+ **/
+
+int main(int argc, char** argv)
+{
+    // Only images are painted, so the tool doesn't need a display.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Renders magic lamp animation frames to PNG files"));
+    parser.addHelpOption();
+
+    const QCommandLineOption directionOption(QStringLiteral("direction"),
+        QStringLiteral("Direction to the icon: left, top, right or bottom."),
+        QStringLiteral("direction"), QStringLiteral("bottom"));
+    const QCommandLineOption kindOption(QStringLiteral("kind"),
+        QStringLiteral("Kind of the animation: minimize or unminimize."),
+        QStringLiteral("kind"), QStringLiteral("minimize"));
+    const QCommandLineOption curveOption(QStringLiteral("curve"),
+        QStringLiteral("Shape curve: linear, quad, cubic, quart, quint, sine, circ, bounce or bezier."),
+        QStringLiteral("curve"), QStringLiteral("sine"));
+    const QCommandLineOption gridResolutionOption(QStringLiteral("grid-resolution"),
+        QStringLiteral("Number of rows and columns in the mesh."),
+        QStringLiteral("resolution"), QStringLiteral("30"));
+    const QCommandLineOption screenSizeOption(QStringLiteral("screen-size"),
+        QStringLiteral("Size of the screen, for example 1920x1080."),
+        QStringLiteral("size"), QStringLiteral("1920x1080"));
+    const QCommandLineOption windowSizeOption(QStringLiteral("window-size"),
+        QStringLiteral("Size of the window, for example 800x600."),
+        QStringLiteral("size"), QStringLiteral("800x600"));
+    const QCommandLineOption textureOption(QStringLiteral("texture"),
+        QStringLiteral("Image used as the contents of the window."),
+        QStringLiteral("file"));
+    const QCommandLineOption frameIntervalOption(QStringLiteral("frame-interval"),
+        QStringLiteral("Time between two frames in milliseconds."),
+        QStringLiteral("ms"), QStringLiteral("16"));
+    const QCommandLineOption outputOption(QStringLiteral("output"),
+        QStringLiteral("Directory where the frames are written."),
+        QStringLiteral("directory"), QStringLiteral("."));
+    const QCommandLineOption benchmarkOption(QStringLiteral("benchmark"),
+        QStringLiteral("Rasterize each frame the given number of times and report the timings instead of writing frames."),
+        QStringLiteral("iterations"));
+
+    parser.addOptions({
+        directionOption,
+        kindOption,
+        curveOption,
+        gridResolutionOption,
+        screenSizeOption,
+        windowSizeOption,
+        textureOption,
+        frameIntervalOption,
+        outputOption,
+        benchmarkOption,
+    });
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    Direction direction;
+    if (!parseDirection(parser.value(directionOption), &direction)) {
+        err << "Unknown direction: " << parser.value(directionOption) << '\n';
+        return 1;
+    }
+
+    Model::AnimationKind kind;
+    if (parser.value(kindOption) == QLatin1String("minimize")) {
+        kind = Model::AnimationKind::Minimize;
+    } else if (parser.value(kindOption) == QLatin1String("unminimize")) {
+        kind = Model::AnimationKind::Unminimize;
+    } else {
+        err << "Unknown animation kind: " << parser.value(kindOption) << '\n';
+        return 1;
+    }
+
+    QEasingCurve curve;
+    if (!parseCurve(parser.value(curveOption), &curve)) {
+        err << "Unknown shape curve: " << parser.value(curveOption) << '\n';
+        return 1;
+    }
+
+    QSize screenSize;
+    QSize windowSize;
+    if (!parseSize(parser.value(screenSizeOption), &screenSize)
+        || !parseSize(parser.value(windowSizeOption), &windowSize)) {
+        err << "Sizes must be specified as WIDTHxHEIGHT" << '\n';
+        return 1;
+    }
+
+    const int gridResolution = parser.value(gridResolutionOption).toInt();
+    const int frameInterval = parser.value(frameIntervalOption).toInt();
+    if (gridResolution <= 0 || frameInterval <= 0) {
+        err << "The grid resolution and the frame interval must be positive" << '\n';
+        return 1;
+    }
+
+    int iterations = 0;
+    if (parser.isSet(benchmarkOption)) {
+        iterations = parser.value(benchmarkOption).toInt();
+        if (iterations <= 0) {
+            err << "The number of iterations must be positive" << '\n';
+            return 1;
+        }
+    }
+
+    QImage texture;
+    if (parser.isSet(textureOption)) {
+        texture = QImage(parser.value(textureOption)).scaled(windowSize);
+        if (texture.isNull()) {
+            err << "Failed to load " << parser.value(textureOption) << '\n';
+            return 1;
+        }
+    } else {
+        texture = makeCheckerboard(windowSize);
+    }
+    texture = texture.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    const QDir outputDir(parser.value(outputOption));
+    if (!iterations && !outputDir.exists()) {
+        err << "The output directory doesn't exist: " << outputDir.path() << '\n';
+        return 1;
+    }
+
+    const Model::Geometry geometry = makeGeometry(direction, screenSize, windowSize);
+
+    Model::Parameters parameters = defaultModelParameters();
+    parameters.shapeCurve = curve;
+
+    Model model;
+    model.setParameters(parameters);
+    model.setGeometry(geometry);
+    model.start(kind);
+
+    SoftwareMeshRenderer renderer;
+    QImage frame(screenSize, QImage::Format_ARGB32_Premultiplied);
+
+    QElapsedTimer timer;
+    qint64 totalTime = 0;
+    int frameCount = 0;
+
+    for (;;) {
+        const QVector<WindowQuad>& quads = model.mesh(gridResolution);
+        const QPointF position = geometry.windowRect.topLeft() + model.translation();
+        const QRegion clipRegion = model.needsClip() ? model.clipRegion() : QRegion(frame.rect());
+
+        if (iterations) {
+            timer.start();
+            for (int i = 0; i < iterations; ++i) {
+                frame.fill(Qt::transparent);
+                renderer.render(&frame, QPoint(0, 0), quads, position, texture, clipRegion);
+            }
+            const qint64 elapsed = timer.nsecsElapsed();
+            totalTime += elapsed;
+            out << "frame " << frameCount << ": " << quads.count() << " quads, "
+                << elapsed / iterations / 1000 << " us" << '\n';
+        } else {
+            frame.fill(Qt::transparent);
+            renderer.render(&frame, QPoint(0, 0), quads, position, texture, clipRegion);
+
+            const QString fileName = QStringLiteral("frame-%1.png").arg(frameCount, 4, 10, QLatin1Char('0'));
+            if (!frame.save(outputDir.filePath(fileName))) {
+                err << "Failed to write " << outputDir.filePath(fileName) << '\n';
+                return 1;
+            }
+        }
+
+        ++frameCount;
+
+        if (model.done()) {
+            break;
+        }
+        model.step(std::chrono::milliseconds(frameInterval));
+    }
+
+    if (iterations) {
+        out << "average: " << totalTime / frameCount / iterations / 1000 << " us per frame" << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "ReferenceKernels.h"
+
+namespace Reference {
+
+static inline qreal interpolate(qreal from, qreal to, qreal t)
+{
+    return from * (1.0 - t) + to * t;
+}
+
+static void transformQuadsLeft(
+    const Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = windowRect.right() - iconRect.right() + params.bumpDistance;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal leftOffset = quad[0].x() - interpolate(0.0, distance, params.squashProgress);
+        const qreal rightOffset = quad[2].x() - interpolate(0.0, distance, params.squashProgress);
+
+        const qreal leftScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.width() - leftOffset) / distance);
+        const qreal rightScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.width() - rightOffset) / distance);
+
+        const qreal targetTopLeftY = iconRect.y() + iconRect.height() * quad[0].y() / windowRect.height();
+        const qreal targetTopRightY = iconRect.y() + iconRect.height() * quad[1].y() / windowRect.height();
+        const qreal targetBottomRightY = iconRect.y() + iconRect.height() * quad[2].y() / windowRect.height();
+        const qreal targetBottomLeftY = iconRect.y() + iconRect.height() * quad[3].y() / windowRect.height();
+
+        quad[0].setY(quad[0].y() + leftScale * (targetTopLeftY - (windowRect.y() + quad[0].y())));
+        quad[3].setY(quad[3].y() + leftScale * (targetBottomLeftY - (windowRect.y() + quad[3].y())));
+        quad[1].setY(quad[1].y() + rightScale * (targetTopRightY - (windowRect.y() + quad[1].y())));
+        quad[2].setY(quad[2].y() + rightScale * (targetBottomRightY - (windowRect.y() + quad[2].y())));
+
+        const qreal targetLeftOffset = leftOffset + params.bumpDistance * params.bumpProgress;
+        const qreal targetRightOffset = rightOffset + params.bumpDistance * params.bumpProgress;
+
+        quad[0].setX(targetLeftOffset);
+        quad[3].setX(targetLeftOffset);
+        quad[1].setX(targetRightOffset);
+        quad[2].setX(targetRightOffset);
+    }
+}
+
+static void transformQuadsTop(
+    const Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = windowRect.bottom() - iconRect.bottom() + params.bumpDistance;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal topOffset = quad[0].y() - interpolate(0.0, distance, params.squashProgress);
+        const qreal bottomOffset = quad[2].y() - interpolate(0.0, distance, params.squashProgress);
+
+        const qreal topScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.height() - topOffset) / distance);
+        const qreal bottomScale = params.stretchProgress * params.shapeCurve.valueForProgress((windowRect.height() - bottomOffset) / distance);
+
+        const qreal targetTopLeftX = iconRect.x() + iconRect.width() * quad[0].x() / windowRect.width();
+        const qreal targetTopRightX = iconRect.x() + iconRect.width() * quad[1].x() / windowRect.width();
+        const qreal targetBottomRightX = iconRect.x() + iconRect.width() * quad[2].x() / windowRect.width();
+        const qreal targetBottomLeftX = iconRect.x() + iconRect.width() * quad[3].x() / windowRect.width();
+
+        quad[0].setX(quad[0].x() + topScale * (targetTopLeftX - (windowRect.x() + quad[0].x())));
+        quad[1].setX(quad[1].x() + topScale * (targetTopRightX - (windowRect.x() + quad[1].x())));
+        quad[2].setX(quad[2].x() + bottomScale * (targetBottomRightX - (windowRect.x() + quad[2].x())));
+        quad[3].setX(quad[3].x() + bottomScale * (targetBottomLeftX - (windowRect.x() + quad[3].x())));
+
+        const qreal targetTopOffset = topOffset + params.bumpDistance * params.bumpProgress;
+        const qreal targetBottomOffset = bottomOffset + params.bumpDistance * params.bumpProgress;
+
+        quad[0].setY(targetTopOffset);
+        quad[1].setY(targetTopOffset);
+        quad[2].setY(targetBottomOffset);
+        quad[3].setY(targetBottomOffset);
+    }
+}
+
+static void transformQuadsRight(
+    const Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = iconRect.left() - windowRect.left() + params.bumpDistance;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal leftOffset = quad[0].x() + interpolate(0.0, distance, params.squashProgress);
+        const qreal rightOffset = quad[2].x() + interpolate(0.0, distance, params.squashProgress);
+
+        const qreal leftScale = params.stretchProgress * params.shapeCurve.valueForProgress(leftOffset / distance);
+        const qreal rightScale = params.stretchProgress * params.shapeCurve.valueForProgress(rightOffset / distance);
+
+        const qreal targetTopLeftY = iconRect.y() + iconRect.height() * quad[0].y() / windowRect.height();
+        const qreal targetTopRightY = iconRect.y() + iconRect.height() * quad[1].y() / windowRect.height();
+        const qreal targetBottomRightY = iconRect.y() + iconRect.height() * quad[2].y() / windowRect.height();
+        const qreal targetBottomLeftY = iconRect.y() + iconRect.height() * quad[3].y() / windowRect.height();
+
+        quad[0].setY(quad[0].y() + leftScale * (targetTopLeftY - (windowRect.y() + quad[0].y())));
+        quad[3].setY(quad[3].y() + leftScale * (targetBottomLeftY - (windowRect.y() + quad[3].y())));
+        quad[1].setY(quad[1].y() + rightScale * (targetTopRightY - (windowRect.y() + quad[1].y())));
+        quad[2].setY(quad[2].y() + rightScale * (targetBottomRightY - (windowRect.y() + quad[2].y())));
+
+        const qreal targetLeftOffset = leftOffset - params.bumpDistance * params.bumpProgress;
+        const qreal targetRightOffset = rightOffset - params.bumpDistance * params.bumpProgress;
+
+        quad[0].setX(targetLeftOffset);
+        quad[3].setX(targetLeftOffset);
+        quad[1].setX(targetRightOffset);
+        quad[2].setX(targetRightOffset);
+    }
+}
+
+static void transformQuadsBottom(
+    const Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    const QRect iconRect = geometry.iconRect;
+    const QRect windowRect = geometry.windowRect;
+
+    const qreal distance = iconRect.top() - windowRect.top() + params.bumpDistance;
+
+    for (int i = 0; i < quads.count(); ++i) {
+        WindowQuad& quad = quads[i];
+
+        const qreal topOffset = quad[0].y() + interpolate(0.0, distance, params.squashProgress);
+        const qreal bottomOffset = quad[2].y() + interpolate(0.0, distance, params.squashProgress);
+
+        const qreal topScale = params.stretchProgress * params.shapeCurve.valueForProgress(topOffset / distance);
+        const qreal bottomScale = params.stretchProgress * params.shapeCurve.valueForProgress(bottomOffset / distance);
+
+        const qreal targetTopLeftX = iconRect.x() + iconRect.width() * quad[0].x() / windowRect.width();
+        const qreal targetTopRightX = iconRect.x() + iconRect.width() * quad[1].x() / windowRect.width();
+        const qreal targetBottomRightX = iconRect.x() + iconRect.width() * quad[2].x() / windowRect.width();
+        const qreal targetBottomLeftX = iconRect.x() + iconRect.width() * quad[3].x() / windowRect.width();
+
+        quad[0].setX(quad[0].x() + topScale * (targetTopLeftX - (windowRect.x() + quad[0].x())));
+        quad[1].setX(quad[1].x() + topScale * (targetTopRightX - (windowRect.x() + quad[1].x())));
+        quad[2].setX(quad[2].x() + bottomScale * (targetBottomRightX - (windowRect.x() + quad[2].x())));
+        quad[3].setX(quad[3].x() + bottomScale * (targetBottomLeftX - (windowRect.x() + quad[3].x())));
+
+        const qreal targetTopOffset = topOffset - params.bumpDistance * params.bumpProgress;
+        const qreal targetBottomOffset = bottomOffset - params.bumpDistance * params.bumpProgress;
+
+        quad[0].setY(targetTopOffset);
+        quad[1].setY(targetTopOffset);
+        quad[2].setY(targetBottomOffset);
+        quad[3].setY(targetBottomOffset);
+    }
+}
+
+void transformQuads(
+    const Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads)
+{
+    switch (params.direction) {
+    case Direction::Left:
+        transformQuadsLeft(geometry, params, quads);
+        break;
+
+    case Direction::Top:
+        transformQuadsTop(geometry, params, quads);
+        break;
+
+    case Direction::Right:
+        transformQuadsRight(geometry, params, quads);
+        break;
+
+    case Direction::Bottom:
+        transformQuadsBottom(geometry, params, quads);
+        break;
+
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+} // namespace Reference
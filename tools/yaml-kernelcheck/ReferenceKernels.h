@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Own
+#include "WindowQuad.h"
+#include "common.h"
+
+// Qt
+#include <QEasingCurve>
+#include <QRect>
+#include <QVector>
+
+/**
+ * Frozen copy of the scalar mesh transformation, as it was before any
+ * optimizations. Do not change it, the output of the kernels in the effect
+ * is compared against it.
+ **/
+namespace Reference {
+
+struct Geometry {
+    QRect windowRect;
+    QRect iconRect;
+};
+
+struct TransformParameters {
+    QEasingCurve shapeCurve;
+    Direction direction;
+    qreal stretchProgress;
+    qreal squashProgress;
+    qreal bumpProgress;
+    qreal bumpDistance;
+};
+
+void transformQuads(
+    const Geometry& geometry,
+    const TransformParameters& params,
+    QVector<WindowQuad>& quads);
+
+} // namespace Reference
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "MeshKernels.h"
+#include "ReferenceKernels.h"
+
+// Qt
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+// std
+#include <cmath>
+
+/**
+ * Runs randomized window and icon geometries, directions, stages and
+ * progress values through the mesh kernels of the effect, and checks that
+ * they produce the same vertices as the frozen reference kernels within a
+ * tolerance. It also reports how much faster each kernel is.
+ **/
+
+using TransformFunction = void (*)(const Model::Geometry&, const TransformParameters&, QVector<WindowQuad>&);
+
+struct Kernel {
+    const char* name;
+    TransformFunction transform;
+};
+
+/**
+ * Runs the mesh transformation without telling it that the quads form a
+ * grid, i.e. the path taken by Model::apply().
+ **/
+static void transformQuadsUngridded(const Model::Geometry& geometry,
+    const TransformParameters& params, QVector<WindowQuad>& quads)
+{
+    TransformParameters ungriddedParams = params;
+    ungriddedParams.gridResolution = 0;
+    transformQuads(geometry, ungriddedParams, quads);
+}
+
+// Optimized variants of the mesh transformation have to be added here.
+static const Kernel kernels[] = {
+    { "transformQuads", transformQuads },
+    { "transformQuads (ungridded)", transformQuadsUngridded },
+};
+
+struct TestCase {
+    Model::Geometry geometry;
+    QEasingCurve shapeCurve;
+    TransformParameters params;
+    Reference::Geometry referenceGeometry;
+    Reference::TransformParameters referenceParams;
+    QVector<WindowQuad> grid;
+};
+
+/**
+ * Builds a grid over the expanded geometry, in the window coordinate space,
+ * same as Model::makeGrid(). Quads of the shadow have negative coordinates
+ * or coordinates past the size of the window.
+ **/
+static QVector<WindowQuad> makeGrid(const QRect& windowRect, const QRect& expandedRect, int gridResolution)
+{
+    QVector<WindowQuad> quads(gridResolution * gridResolution);
+
+    const qreal x0 = expandedRect.x() - windowRect.x();
+    const qreal y0 = expandedRect.y() - windowRect.y();
+    const qreal dx = qreal(expandedRect.width()) / gridResolution;
+    const qreal dy = qreal(expandedRect.height()) / gridResolution;
+    const qreal du = 1.0 / gridResolution;
+    const qreal dv = 1.0 / gridResolution;
+
+    for (int i = 0; i < gridResolution; ++i) {
+        for (int j = 0; j < gridResolution; ++j) {
+            WindowQuad& quad = quads[i * gridResolution + j];
+            quad[0] = WindowVertex(QPointF(x0 + j * dx, y0 + i * dy), QPointF(j * du, i * dv));
+            quad[1] = WindowVertex(QPointF(x0 + (j + 1) * dx, y0 + i * dy), QPointF((j + 1) * du, i * dv));
+            quad[2] = WindowVertex(QPointF(x0 + (j + 1) * dx, y0 + (i + 1) * dy), QPointF((j + 1) * du, (i + 1) * dv));
+            quad[3] = WindowVertex(QPointF(x0 + j * dx, y0 + (i + 1) * dy), QPointF(j * du, (i + 1) * dv));
+        }
+    }
+
+    return quads;
+}
+
+static QEasingCurve randomCurve(QRandomGenerator& random)
+{
+    static const QEasingCurve::Type types[] = {
+        QEasingCurve::Linear,
+        QEasingCurve::InOutQuad,
+        QEasingCurve::InOutCubic,
+        QEasingCurve::InOutQuart,
+        QEasingCurve::InOutQuint,
+        QEasingCurve::InOutSine,
+        QEasingCurve::InOutCirc,
+        QEasingCurve::InOutBounce,
+    };
+
+    const int index = random.bounded(int(sizeof(types) / sizeof(types[0])) + 1);
+    if (index == int(sizeof(types) / sizeof(types[0]))) {
+        QEasingCurve curve(QEasingCurve::BezierSpline);
+        curve.addCubicBezierSegment(QPointF(0.3, 0.0), QPointF(0.7, 1.0), QPointF(1.0, 1.0));
+        return curve;
+    }
+
+    return QEasingCurve(types[index]);
+}
+
+static TestCase makeTestCase(QRandomGenerator& random, int gridResolution)
+{
+    const QRect screenRect(0, 0, 1920, 1080);
+    const int iconSize = 48;
+
+    TestCase testCase;
+    Model::Geometry& geometry = testCase.geometry;
+
+    geometry.screenRect = screenRect;
+    geometry.direction = static_cast<Direction>(random.bounded(4));
+
+    const int width = random.bounded(100, screenRect.width());
+    const int height = random.bounded(100, screenRect.height());
+    geometry.windowRect = QRect(random.bounded(screenRect.width() - width + 1),
+        random.bounded(screenRect.height() - height + 1), width, height);
+
+    // Half of the windows have a shadow, which is usually larger below the
+    // window than above it.
+    if (random.bounded(2)) {
+        geometry.expandedRect = geometry.windowRect.adjusted(-random.bounded(1, 64), -random.bounded(1, 64),
+            random.bounded(1, 64), random.bounded(1, 64));
+    } else {
+        geometry.expandedRect = geometry.windowRect;
+    }
+
+    // The window is raised above the panel, same as in Model::computeBumpDistance().
+    int bumpDistance = 0;
+    switch (geometry.direction) {
+    case Direction::Left:
+        geometry.iconRect = QRect(0, random.bounded(screenRect.height() - iconSize), iconSize, iconSize);
+        bumpDistance = qMax(0, geometry.iconRect.x() + iconSize - geometry.windowRect.x());
+        break;
+
+    case Direction::Top:
+        geometry.iconRect = QRect(random.bounded(screenRect.width() - iconSize), 0, iconSize, iconSize);
+        bumpDistance = qMax(0, geometry.iconRect.y() + iconSize - geometry.windowRect.y());
+        break;
+
+    case Direction::Right:
+        geometry.iconRect = QRect(screenRect.width() - iconSize, random.bounded(screenRect.height() - iconSize), iconSize, iconSize);
+        bumpDistance = qMax(0, geometry.windowRect.x() + width - geometry.iconRect.x());
+        break;
+
+    case Direction::Bottom:
+        geometry.iconRect = QRect(random.bounded(screenRect.width() - iconSize), screenRect.height() - iconSize, iconSize, iconSize);
+        bumpDistance = qMax(0, geometry.windowRect.y() + height - geometry.iconRect.y());
+        break;
+    }
+
+    // Same as Model::applyBump(), applyStretch1(), applyStretch2() and applySquash().
+    // The curve is hooked up to the parameters once all cases are generated.
+    TransformParameters& params = testCase.params;
+    testCase.shapeCurve = randomCurve(random);
+    params.shapeCurve = nullptr;
+    params.direction = geometry.direction;
+    params.bumpDistance = bumpDistance;
+    params.gridResolution = gridResolution;
+
+    const qreal shapeFactor = 0.05 + random.generateDouble() * 0.45;
+    const qreal progress = random.generateDouble();
+    switch (random.bounded(4)) {
+    case 0:
+        params.squashProgress = 0.0;
+        params.stretchProgress = 0.0;
+        params.bumpProgress = progress;
+        break;
+
+    case 1:
+        params.squashProgress = 0.0;
+        params.stretchProgress = shapeFactor * progress;
+        params.bumpProgress = 1.0;
+        break;
+
+    case 2:
+        params.squashProgress = 0.0;
+        params.stretchProgress = shapeFactor * progress;
+        params.bumpProgress = params.stretchProgress;
+        break;
+
+    case 3:
+        params.squashProgress = progress;
+        params.stretchProgress = qMin(shapeFactor + progress, 1.0);
+        params.bumpProgress = 1.0;
+        break;
+    }
+
+    testCase.referenceGeometry.windowRect = geometry.windowRect;
+    testCase.referenceGeometry.iconRect = geometry.iconRect;
+
+    testCase.referenceParams.shapeCurve = testCase.shapeCurve;
+    testCase.referenceParams.direction = params.direction;
+    testCase.referenceParams.stretchProgress = params.stretchProgress;
+    testCase.referenceParams.squashProgress = params.squashProgress;
+    testCase.referenceParams.bumpProgress = params.bumpProgress;
+    testCase.referenceParams.bumpDistance = params.bumpDistance;
+
+    testCase.grid = makeGrid(geometry.windowRect, geometry.expandedRect, gridResolution);
+
+    return testCase;
+}
+
+static void runReference(const TestCase& testCase, QVector<WindowQuad>& quads)
+{
+    quads = testCase.grid;
+    Reference::transformQuads(testCase.referenceGeometry, testCase.referenceParams, quads);
+}
+
+static qreal maximumError(const QVector<WindowQuad>& expected, const QVector<WindowQuad>& actual)
+{
+    if (expected.count() != actual.count()) {
+        return qInf();
+    }
+
+    qreal error = 0.0;
+    for (int i = 0; i < expected.count(); ++i) {
+        for (int j = 0; j < 4; ++j) {
+            error = qMax(error, std::abs(expected[i][j].x() - actual[i][j].x()));
+            error = qMax(error, std::abs(expected[i][j].y() - actual[i][j].y()));
+        }
+    }
+    return error;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Checks the mesh kernels against the reference implementation"));
+    parser.addHelpOption();
+
+    const QCommandLineOption casesOption(QStringLiteral("cases"),
+        QStringLiteral("Number of randomized test cases."),
+        QStringLiteral("count"), QStringLiteral("1000"));
+    const QCommandLineOption seedOption(QStringLiteral("seed"),
+        QStringLiteral("Seed of the random number generator."),
+        QStringLiteral("seed"), QStringLiteral("1"));
+    const QCommandLineOption gridResolutionOption(QStringLiteral("grid-resolution"),
+        QStringLiteral("Number of rows and columns in the mesh."),
+        QStringLiteral("resolution"), QStringLiteral("30"));
+    const QCommandLineOption toleranceOption(QStringLiteral("tolerance"),
+        QStringLiteral("Maximum allowed vertex error in pixels."),
+        QStringLiteral("pixels"), QStringLiteral("0.01"));
+    const QCommandLineOption iterationsOption(QStringLiteral("iterations"),
+        QStringLiteral("How many times all test cases are run when measuring speed."),
+        QStringLiteral("count"), QStringLiteral("10"));
+
+    parser.addOptions({
+        casesOption,
+        seedOption,
+        gridResolutionOption,
+        toleranceOption,
+        iterationsOption,
+    });
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    const int caseCount = parser.value(casesOption).toInt();
+    const int gridResolution = parser.value(gridResolutionOption).toInt();
+    const int iterations = parser.value(iterationsOption).toInt();
+    const qreal tolerance = parser.value(toleranceOption).toDouble();
+    if (caseCount <= 0 || gridResolution <= 0 || iterations <= 0) {
+        out << "The number of cases, the grid resolution and the number of iterations must be positive\n";
+        return 1;
+    }
+
+    QRandomGenerator random(parser.value(seedOption).toUInt());
+    QVector<TestCase> testCases;
+    testCases.reserve(caseCount);
+    for (int i = 0; i < caseCount; ++i) {
+        testCases.append(makeTestCase(random, gridResolution));
+    }
+    for (TestCase& testCase : testCases) {
+        testCase.params.shapeCurve = &testCase.shapeCurve;
+    }
+
+    QVector<QVector<WindowQuad>> expected(caseCount);
+    for (int i = 0; i < caseCount; ++i) {
+        runReference(testCases[i], expected[i]);
+    }
+
+    QVector<WindowQuad> quads;
+    QElapsedTimer timer;
+
+    timer.start();
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        for (const TestCase& testCase : testCases) {
+            runReference(testCase, quads);
+        }
+    }
+    const qint64 referenceTime = timer.nsecsElapsed();
+
+    out << "reference: " << referenceTime / iterations / 1000 << " us per run\n";
+
+    bool ok = true;
+    for (const Kernel& kernel : kernels) {
+        qreal error = 0.0;
+        int failedCase = -1;
+        for (int i = 0; i < caseCount; ++i) {
+            quads = testCases[i].grid;
+            kernel.transform(testCases[i].geometry, testCases[i].params, quads);
+
+            const qreal caseError = maximumError(expected[i], quads);
+            if (caseError > error) {
+                error = caseError;
+            }
+            if (caseError > tolerance && failedCase == -1) {
+                failedCase = i;
+            }
+        }
+
+        timer.start();
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            for (const TestCase& testCase : testCases) {
+                quads = testCase.grid;
+                kernel.transform(testCase.geometry, testCase.params, quads);
+            }
+        }
+        const qint64 kernelTime = timer.nsecsElapsed();
+
+        out << kernel.name << ": " << kernelTime / iterations / 1000 << " us per run, "
+            << "speedup " << qreal(referenceTime) / qMax(kernelTime, qint64(1)) << "x, "
+            << "max error " << error << " px";
+
+        if (failedCase != -1) {
+            const TestCase& testCase = testCases[failedCase];
+            out << " FAIL (first failing case " << failedCase
+                << ": direction " << static_cast<int>(testCase.params.direction)
+                << ", stretch " << testCase.params.stretchProgress
+                << ", squash " << testCase.params.squashProgress
+                << ", bump " << testCase.params.bumpProgress << ")";
+            ok = false;
+        }
+        out << '\n';
+    }
+
+    return ok ? 0 : 1;
+}
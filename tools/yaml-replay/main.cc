@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "AnimationScheduler.h"
+#include "Fixture.h"
+#include "Model.h"
+
+// Qt
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QRegularExpression>
+#include <QTextStream>
+
+// std
+#include <algorithm>
+
+/**
+ * Replays a trace of window events through the animation scheduler and the
+ * animation model, the same way the effect drives them, and reports the CPU
+ * time spent per frame and how late every animation finished. Offscreen
+ * rendering and the GPU are not part of the measurement.
+ *
+ * A trace has one event per line, ordered by time:
+ *
+ *   # time(ms) event window [x y width height]
+ *   0 map 1 100 100 800 600
+ *   10 minimize 1
+ *   20 unminimize 1
+ *   30 geometry 1 120 100 800 600
+ *   40 damage 1
+ *   50 delete 1
+ *
+ * Instead of a trace, a built-in scenario can be replayed. The scenario
+ * show-desktop:COUNT:SPREAD maps COUNT windows and minimizes all of them
+ * within SPREAD milliseconds.
+ **/
+
+enum class EventType {
+    Map,
+    Minimize,
+    Unminimize,
+    Geometry,
+    Damage,
+    Delete
+};
+
+struct Event {
+    std::chrono::milliseconds time;
+    EventType type;
+    int window;
+    QRect rect;
+};
+
+struct Animation {
+    Model model;
+
+    // When the window was minimized or unminimized.
+    std::chrono::milliseconds requestTime;
+
+    // When the animation was admitted by the scheduler.
+    std::chrono::milliseconds startTime;
+
+    // How long the animation takes if no frame is late.
+    std::chrono::milliseconds nominalDuration;
+
+    // Reversed animations have no meaningful deadline.
+    bool reversed = false;
+};
+
+// The shadow around every window.
+static const int shadowSize = 30;
+
+static KWin::EffectWindow* windowKey(int window)
+{
+    // The scheduler only compares the windows, they are never dereferenced.
+    return reinterpret_cast<KWin::EffectWindow*>(quintptr(window));
+}
+
+static bool parseEvent(const QString& line, Event* event)
+{
+    const QStringList parts = line.split(QRegularExpression(QStringLiteral("\\s+")));
+    if (parts.count() < 3) {
+        return false;
+    }
+
+    bool timeOk = false;
+    bool windowOk = false;
+    event->time = std::chrono::milliseconds(parts[0].toLongLong(&timeOk));
+    event->window = parts[2].toInt(&windowOk);
+    if (!timeOk || !windowOk || event->window <= 0) {
+        return false;
+    }
+
+    const QString& type = parts[1];
+    if (type == QLatin1String("map")) {
+        event->type = EventType::Map;
+    } else if (type == QLatin1String("minimize")) {
+        event->type = EventType::Minimize;
+    } else if (type == QLatin1String("unminimize")) {
+        event->type = EventType::Unminimize;
+    } else if (type == QLatin1String("geometry")) {
+        event->type = EventType::Geometry;
+    } else if (type == QLatin1String("damage")) {
+        event->type = EventType::Damage;
+    } else if (type == QLatin1String("delete")) {
+        event->type = EventType::Delete;
+    } else {
+        return false;
+    }
+
+    if (event->type == EventType::Map || event->type == EventType::Geometry) {
+        if (parts.count() != 7) {
+            return false;
+        }
+        int values[4];
+        for (int i = 0; i < 4; ++i) {
+            bool ok = false;
+            values[i] = parts[3 + i].toInt(&ok);
+            if (!ok) {
+                return false;
+            }
+        }
+        event->rect = QRect(values[0], values[1], values[2], values[3]);
+    } else if (parts.count() != 3) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool loadTrace(const QString& fileName, QVector<Event>* events, QTextStream& err)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        err << "Failed to open " << fileName << '\n';
+        return false;
+    }
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while (!in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#'))) {
+            continue;
+        }
+
+        Event event;
+        if (!parseEvent(line, &event)) {
+            err << fileName << ':' << lineNumber << ": invalid event" << '\n';
+            return false;
+        }
+        events->append(event);
+    }
+
+    return true;
+}
+
+static bool makeScenario(const QString& name, const QSize& screenSize, QVector<Event>* events)
+{
+    const QStringList parts = name.split(QLatin1Char(':'));
+    if (parts.count() != 3 || parts[0] != QLatin1String("show-desktop")) {
+        return false;
+    }
+
+    bool countOk = false;
+    bool spreadOk = false;
+    const int count = parts[1].toInt(&countOk);
+    const int spread = parts[2].toInt(&spreadOk);
+    if (!countOk || !spreadOk || count <= 0 || spread < 0) {
+        return false;
+    }
+
+    // Cascade the windows over the screen, then minimize them one after
+    // another, as if "Show Desktop" was triggered.
+    const QSize windowSize = screenSize / 2;
+    for (int i = 0; i < count; ++i) {
+        const int offset = (i * 32) % (screenSize.height() / 2);
+        events->append({ std::chrono::milliseconds::zero(), EventType::Map, i + 1,
+            QRect(QPoint(offset, offset), windowSize) });
+    }
+    for (int i = 0; i < count; ++i) {
+        const std::chrono::milliseconds time(count > 1 ? spread * i / (count - 1) : 0);
+        events->append({ time, EventType::Minimize, i + 1, QRect() });
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays window events through the magic lamp animation"));
+    parser.addHelpOption();
+
+    const QCommandLineOption traceOption(QStringLiteral("trace"),
+        QStringLiteral("File with the window events to replay."),
+        QStringLiteral("file"));
+    const QCommandLineOption scenarioOption(QStringLiteral("scenario"),
+        QStringLiteral("Built-in scenario to replay, for example show-desktop:40:50."),
+        QStringLiteral("scenario"));
+    const QCommandLineOption directionOption(QStringLiteral("direction"),
+        QStringLiteral("Direction to the icons: left, top, right or bottom."),
+        QStringLiteral("direction"), QStringLiteral("bottom"));
+    const QCommandLineOption gridResolutionOption(QStringLiteral("grid-resolution"),
+        QStringLiteral("Number of rows and columns in the mesh."),
+        QStringLiteral("resolution"), QStringLiteral("30"));
+    const QCommandLineOption screenSizeOption(QStringLiteral("screen-size"),
+        QStringLiteral("Size of the screen, for example 1920x1080."),
+        QStringLiteral("size"), QStringLiteral("1920x1080"));
+    const QCommandLineOption frameIntervalOption(QStringLiteral("frame-interval"),
+        QStringLiteral("Time between two frames in milliseconds."),
+        QStringLiteral("ms"), QStringLiteral("16"));
+
+    parser.addOptions({
+        traceOption,
+        scenarioOption,
+        directionOption,
+        gridResolutionOption,
+        screenSizeOption,
+        frameIntervalOption,
+    });
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    Direction direction;
+    if (!parseDirection(parser.value(directionOption), &direction)) {
+        err << "Unknown direction: " << parser.value(directionOption) << '\n';
+        return 1;
+    }
+
+    QSize screenSize;
+    if (!parseSize(parser.value(screenSizeOption), &screenSize)) {
+        err << "Sizes must be specified as WIDTHxHEIGHT" << '\n';
+        return 1;
+    }
+
+    const int gridResolution = parser.value(gridResolutionOption).toInt();
+    const std::chrono::milliseconds frameInterval(parser.value(frameIntervalOption).toInt());
+    if (gridResolution <= 0 || frameInterval.count() <= 0) {
+        err << "The grid resolution and the frame interval must be positive" << '\n';
+        return 1;
+    }
+
+    QVector<Event> events;
+    if (parser.isSet(traceOption) == parser.isSet(scenarioOption)) {
+        err << "Either a trace or a scenario has to be specified" << '\n';
+        return 1;
+    }
+    if (parser.isSet(traceOption)) {
+        if (!loadTrace(parser.value(traceOption), &events, err)) {
+            return 1;
+        }
+    } else if (!makeScenario(parser.value(scenarioOption), screenSize, &events)) {
+        err << "Unknown scenario: " << parser.value(scenarioOption) << '\n';
+        return 1;
+    }
+    std::stable_sort(events.begin(), events.end(),
+        [](const Event& a, const Event& b) { return a.time < b.time; });
+
+    const Model::Parameters parameters = defaultModelParameters();
+    const QRect screenRect(QPoint(0, 0), screenSize);
+    const QRect iconRect = iconRectForDirection(direction, screenRect);
+
+    QMap<int, Model::Geometry> windows;
+    QMap<int, Animation> animations;
+    QMap<int, std::chrono::milliseconds> requestTimes;
+    AnimationScheduler scheduler;
+    QVector<AnimationScheduler::PendingAnimation> admitted;
+
+    QElapsedTimer timer;
+    qint64 totalFrameTime = 0;
+    qint64 maximumFrameTime = 0;
+    int frameCount = 0;
+    int damageCount = 0;
+
+    std::chrono::milliseconds maximumLateness = std::chrono::milliseconds::zero();
+    std::chrono::milliseconds totalLateness = std::chrono::milliseconds::zero();
+    int finishedCount = 0;
+
+    std::chrono::milliseconds time = std::chrono::milliseconds::zero();
+    bool animating = false;
+    int eventIndex = 0;
+
+    while (eventIndex < events.count() || animating) {
+        // Deliver the events that happened since the previous frame.
+        for (; eventIndex < events.count() && events[eventIndex].time <= time; ++eventIndex) {
+            const Event& event = events[eventIndex];
+            KWin::EffectWindow* key = windowKey(event.window);
+
+            if (event.type != EventType::Map && !windows.contains(event.window)) {
+                err << "Event for unknown window " << event.window << " at " << event.time.count() << " ms" << '\n';
+                return 1;
+            }
+
+            switch (event.type) {
+            case EventType::Map:
+            case EventType::Geometry: {
+                Model::Geometry& geometry = windows[event.window];
+                geometry.direction = direction;
+                geometry.screenRect = screenRect;
+                geometry.iconRect = iconRect;
+                geometry.windowRect = event.rect;
+                geometry.expandedRect = event.rect.adjusted(-shadowSize, -shadowSize, shadowSize, shadowSize);
+
+                auto animationIt = animations.find(event.window);
+                if (animationIt != animations.end()) {
+                    (*animationIt).model.setGeometry(geometry);
+                }
+                break;
+            }
+
+            case EventType::Minimize:
+            case EventType::Unminimize: {
+                const Model::AnimationKind kind = event.type == EventType::Minimize
+                    ? Model::AnimationKind::Minimize
+                    : Model::AnimationKind::Unminimize;
+
+                // The scheduler decides the same way as for the effect.
+                auto animationIt = animations.find(event.window);
+                Model* model = animationIt != animations.end() ? &(*animationIt).model : nullptr;
+                const QRect expandedRect = windows[event.window].expandedRect;
+
+                switch (scheduler.request(key, kind, model, true, qint64(expandedRect.width()) * expandedRect.height())) {
+                case AnimationScheduler::RequestResult::Reversed:
+                    (*animationIt).reversed = true;
+                    break;
+
+                case AnimationScheduler::RequestResult::Cancelled:
+                    requestTimes.remove(event.window);
+                    break;
+
+                case AnimationScheduler::RequestResult::Scheduled:
+                    requestTimes[event.window] = event.time;
+                    break;
+
+                case AnimationScheduler::RequestResult::Ignored:
+                    break;
+                }
+                break;
+            }
+
+            case EventType::Damage:
+                // Damage only re-renders the offscreen texture.
+                ++damageCount;
+                break;
+
+            case EventType::Delete:
+                windows.remove(event.window);
+                animations.remove(event.window);
+                requestTimes.remove(event.window);
+                scheduler.remove(key);
+                break;
+            }
+        }
+
+        // The effect doesn't step the models on the first frame after it
+        // has been idle, see YetAnotherMagicLampEffect::prePaintScreen().
+        const std::chrono::milliseconds delta = animating ? frameInterval : std::chrono::milliseconds::zero();
+
+        timer.start();
+
+        for (Animation& animation : animations) {
+            animation.model.step(delta);
+        }
+
+        scheduler.admit(delta, admitted);
+        for (const AnimationScheduler::PendingAnimation& pending : admitted) {
+            const int window = int(quintptr(pending.window));
+
+            Animation& animation = animations[window];
+            animation.model.setParameters(parameters);
+            animation.model.setGeometry(windows[window]);
+            animation.model.start(pending.kind);
+            animation.requestTime = requestTimes.take(window);
+            animation.startTime = time;
+            animation.reversed = false;
+        }
+
+        for (Animation& animation : animations) {
+            animation.model.mesh(gridResolution);
+            if (animation.model.needsClip()) {
+                animation.model.clipRegion();
+            }
+        }
+
+        const qint64 frameTime = timer.nsecsElapsed();
+
+        // Measure the nominal durations outside of the timed part.
+        for (const AnimationScheduler::PendingAnimation& pending : admitted) {
+            Animation& animation = animations[int(quintptr(pending.window))];
+            animation.nominalDuration = nominalDuration(parameters, animation.model.geometry(), pending.kind);
+        }
+
+        if (!animations.isEmpty() || !scheduler.isEmpty()) {
+            totalFrameTime += frameTime;
+            maximumFrameTime = std::max(maximumFrameTime, frameTime);
+            ++frameCount;
+        }
+
+        auto animationIt = animations.begin();
+        while (animationIt != animations.end()) {
+            const Animation& animation = *animationIt;
+            if (!animation.model.done()) {
+                ++animationIt;
+                continue;
+            }
+
+            if (animation.reversed) {
+                out << "window " << animationIt.key() << ": reversed" << '\n';
+            } else {
+                const std::chrono::milliseconds lateness = time - animation.requestTime - animation.nominalDuration;
+                out << "window " << animationIt.key()
+                    << ": admitted after " << (animation.startTime - animation.requestTime).count() << " ms"
+                    << ", finished " << lateness.count() << " ms late" << '\n';
+                totalLateness += lateness;
+                maximumLateness = std::max(maximumLateness, lateness);
+                ++finishedCount;
+            }
+
+            animationIt = animations.erase(animationIt);
+        }
+
+        animating = !animations.isEmpty() || !scheduler.isEmpty();
+        time += frameInterval;
+    }
+
+    if (frameCount) {
+        out << frameCount << " frames, "
+            << totalFrameTime / frameCount / 1000 << " us average, "
+            << maximumFrameTime / 1000 << " us maximum per frame" << '\n';
+    }
+    if (finishedCount) {
+        out << finishedCount << " animations, "
+            << totalLateness.count() / finishedCount << " ms average, "
+            << maximumLateness.count() << " ms maximum lateness" << '\n';
+    }
+    if (damageCount) {
+        out << damageCount << " damage events, not measured without offscreen rendering" << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018 Vlad Zagorodniy <vladzzag@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Own
+#include "Fixture.h"
+#include "Model.h"
+#include "SoftwareMeshRenderer.h"
+
+// Qt
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QPainter>
+#include <QTextStream>
+
+/**
+ * Measures how long the QPainter backend of the effect takes to paint the
+ * frames of minimize and unminimize animations at 1080p and 4K, in every
+ * direction. Frames are painted the same way as by the effect: the mesh is
+ * rasterized into a scratch image that covers only the painted part of the
+ * window, which is then drawn onto the screen.
+ **/
+
+struct Preset {
+    const char* name;
+    QSize screenSize;
+    QSize windowSize;
+};
+
+static const Preset presets[] = {
+    { "1080p", QSize(1920, 1080), QSize(1280, 720) },
+    { "4K", QSize(3840, 2160), QSize(2560, 1440) },
+};
+
+struct Timings {
+    qint64 totalTime = 0;
+    qint64 maximumTime = 0;
+    int frameCount = 0;
+};
+
+/**
+ * Paints the current frame of the model onto the screen, like
+ * YetAnotherMagicLampEffect::drawWindowInSoftware().
+ **/
+static void paintFrame(Model& model, int gridResolution, const QImage& texture,
+    QImage& scratch, QImage& screen, const SoftwareMeshRenderer& renderer)
+{
+    const QRect paintRect = screen.rect() & model.boundingRect();
+    if (paintRect.isEmpty()) {
+        return;
+    }
+
+    if (scratch.width() < paintRect.width() || scratch.height() < paintRect.height()) {
+        scratch = QImage(paintRect.size().expandedTo(scratch.size()), QImage::Format_ARGB32_Premultiplied);
+    }
+
+    QImage frame(scratch.bits(), paintRect.width(), paintRect.height(),
+        scratch.bytesPerLine(), QImage::Format_ARGB32_Premultiplied);
+    frame.fill(Qt::transparent);
+
+    const QRegion clipRegion = model.needsClip() ? model.clipRegion() : QRegion(paintRect);
+    const QPointF position = model.geometry().windowRect.topLeft() + model.translation();
+    renderer.render(&frame, paintRect.topLeft(), model.mesh(gridResolution), position, texture, clipRegion);
+
+    QPainter painter(&screen);
+    painter.drawImage(paintRect.topLeft(), frame);
+}
+
+static Timings runAnimation(const Preset& preset, Direction direction, Model::AnimationKind kind,
+    int gridResolution, int frameInterval, int iterations)
+{
+    const Model::Geometry geometry = makeGeometry(direction, preset.screenSize, preset.windowSize);
+    const QImage texture = makeCheckerboard(preset.windowSize);
+
+    Model model;
+    model.setParameters(defaultModelParameters());
+    model.setGeometry(geometry);
+    model.start(kind);
+
+    SoftwareMeshRenderer renderer;
+    QImage scratch;
+    QImage screen(preset.screenSize, QImage::Format_ARGB32_Premultiplied);
+    screen.fill(Qt::black);
+
+    Timings timings;
+    QElapsedTimer timer;
+
+    for (;;) {
+        // The mesh is built outside of the timed loop, like the effect
+        // builds it in prePaintScreen().
+        model.mesh(gridResolution);
+
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            paintFrame(model, gridResolution, texture, scratch, screen, renderer);
+        }
+        const qint64 frameTime = timer.nsecsElapsed() / iterations;
+
+        timings.totalTime += frameTime;
+        timings.maximumTime = qMax(timings.maximumTime, frameTime);
+        ++timings.frameCount;
+
+        if (model.done()) {
+            break;
+        }
+        model.step(std::chrono::milliseconds(frameInterval));
+    }
+
+    return timings;
+}
+
+int main(int argc, char** argv)
+{
+    // Only images are painted, so the tool doesn't need a display.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks the QPainter backend of the effect at 1080p and 4K"));
+    parser.addHelpOption();
+
+    const QCommandLineOption gridResolutionOption(QStringLiteral("grid-resolution"),
+        QStringLiteral("Number of rows and columns in the mesh."),
+        QStringLiteral("resolution"), QStringLiteral("30"));
+    const QCommandLineOption frameIntervalOption(QStringLiteral("frame-interval"),
+        QStringLiteral("Time between two frames in milliseconds."),
+        QStringLiteral("ms"), QStringLiteral("16"));
+    const QCommandLineOption iterationsOption(QStringLiteral("iterations"),
+        QStringLiteral("How many times each frame is painted."),
+        QStringLiteral("count"), QStringLiteral("5"));
+
+    parser.addOptions({
+        gridResolutionOption,
+        frameIntervalOption,
+        iterationsOption,
+    });
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    const int gridResolution = parser.value(gridResolutionOption).toInt();
+    const int frameInterval = parser.value(frameIntervalOption).toInt();
+    const int iterations = parser.value(iterationsOption).toInt();
+    if (gridResolution <= 0 || frameInterval <= 0 || iterations <= 0) {
+        err << "The grid resolution, the frame interval and the number of iterations must be positive" << '\n';
+        return 1;
+    }
+
+    const Direction directions[] = { Direction::Left, Direction::Top, Direction::Right, Direction::Bottom };
+    const char* directionNames[] = { "left", "top", "right", "bottom" };
+    const Model::AnimationKind kinds[] = { Model::AnimationKind::Minimize, Model::AnimationKind::Unminimize };
+    const char* kindNames[] = { "minimize", "unminimize" };
+
+    for (const Preset& preset : presets) {
+        Timings presetTimings;
+
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                const Timings timings = runAnimation(preset, directions[i], kinds[j],
+                    gridResolution, frameInterval, iterations);
+
+                out << preset.name << " " << directionNames[i] << " " << kindNames[j] << ": "
+                    << timings.frameCount << " frames, average "
+                    << timings.totalTime / timings.frameCount / 1000 << " us, max "
+                    << timings.maximumTime / 1000 << " us" << '\n';
+
+                presetTimings.totalTime += timings.totalTime;
+                presetTimings.maximumTime = qMax(presetTimings.maximumTime, timings.maximumTime);
+                presetTimings.frameCount += timings.frameCount;
+            }
+        }
+
+        out << preset.name << ": average " << presetTimings.totalTime / presetTimings.frameCount / 1000
+            << " us per frame, max " << presetTimings.maximumTime / 1000 << " us" << '\n';
+    }
+
+    return 0;
+}